@@ -8,6 +8,18 @@
 
 #include "TFT_eFEX.h"
 
+// Decoded image held by the image cache, entries are linked most recently used first
+typedef struct image_cache_entry_t {
+  struct image_cache_entry_t *next;
+  char          *path;      // File path, nullptr for an array
+  const uint8_t *data;      // Array address
+  uint32_t       size;      // Source size in bytes
+  uint32_t       mtime;     // File last write time, so a rewritten file is decoded again
+  uint16_t       width;
+  uint16_t       height;
+  uint16_t      *pixels;    // 565 in panel byte order
+} image_cache_entry_t;
+
 
 /***************************************************************************************
 ** Function name:           TFT_eFEX
@@ -20,6 +32,20 @@ TFT_eFEX::TFT_eFEX(TFT_eSPI *tft)
 }
 
 
+/***************************************************************************************
+** Function name:           ~TFT_eFEX
+** Description:             Class destructor
+***************************************************************************************/
+TFT_eFEX::~TFT_eFEX(void)
+{
+  clearImageCache();
+  clearBackground();
+#ifdef ESP32
+  if (jpg_work_owned) free(jpg_work); // Native jpeg decoder work buffer
+#endif
+}
+
+
 /***************************************************************************************
 ** Function name:           drawQuadraticBezier
 ** Description:             Draw a bezier curve between points
@@ -135,7 +161,9 @@ void TFT_eFEX::drawBezierSegment(int32_t x0, int32_t y0, int32_t x1, int32_t y1,
 ** Description:             draw a bitmap stored in SPIFFS onto the TFT or in a Sprite
 ***************************************************************************************/
 //void TFT_eFEX::drawBmp(const char *filename, int16_t x, int16_t y, TFT_eSprite *_spr) {
-void TFT_eFEX::drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr) {
+void TFT_eFEX::drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr, image_stats_t *stats) {
+
+  if (stats) memset(stats, 0, sizeof(image_stats_t));
 
   if ( (_spr == nullptr) && ((x >= _tft->width()) || (y >= _tft->height()))) return;
 
@@ -158,10 +186,22 @@ void TFT_eFEX::drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr)
   }
 
   uint32_t seekOffset;
-  uint16_t w, h, row, col;
-  uint8_t  r, g, b;
+  uint16_t w, h, row;
 
-  //uint32_t startTime = millis();
+  uint32_t startTime = micros();
+  uint32_t t = 0;
+
+  // Images in the cache are pushed without reading the file
+  image_cache_entry_t *entry = nullptr;
+  uint32_t mtime = bmpFS.getLastWrite();
+  if (img_cache_stats.budget) entry = cacheFind(filename.c_str(), nullptr, bmpFS.size(), mtime);
+  if (entry)
+  {
+    cacheDraw(entry, x, y, _spr, stats);
+    bmpFS.close();
+    if (stats) stats->totalTime = micros() - startTime;
+    return;
+  }
 
   if (read16(bmpFS) == 0x4D42)
   {
@@ -174,6 +214,40 @@ void TFT_eFEX::drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr)
 
     if ((read16(bmpFS) == 1) && (read16(bmpFS) == 24) && (read32(bmpFS) == 0))
     {
+      if (img_cache_stats.budget) entry = cacheAdd(filename.c_str(), nullptr, bmpFS.size(), mtime, w, h);
+
+      // Read the whole image into the cache in panel byte order, then push it from there
+      if (entry)
+      {
+        bmpFS.seek(seekOffset);
+
+        uint16_t padding = (4 - ((w * 3) & 3)) & 3;
+        uint8_t lineBuffer[w * 3 + padding] __attribute__((aligned(4))); // Word aligned for rgb565Row()
+
+        for (row = 0; row < h; row++) {
+          if (stats) t = micros();
+          bmpFS.read(lineBuffer, sizeof(lineBuffer));
+          if (stats) { stats->readTime += micros() - t; t = micros(); }
+
+          uint16_t* tptr = entry->pixels + (uint32_t)(h - 1 - row) * w; // BMP rows are bottom up
+          if (color_dither) rgb565DitherRow(lineBuffer, tptr, w, 0, h - 1 - row, true, true);
+          else              rgb565Row(lineBuffer, tptr, w, true, true);
+          if (stats) stats->convertTime += micros() - t;
+        }
+
+        cacheDraw(entry, x, y, _spr, stats);
+
+        if (stats)
+        {
+          stats->blocks     = h;
+          stats->bytesRead  = seekOffset + (uint32_t)h * sizeof(lineBuffer);
+          stats->peakBuffer = sizeof(lineBuffer);
+        }
+        bmpFS.close();
+        if (stats) stats->totalTime = micros() - startTime;
+        return;
+      }
+
       y += h - 1;
       
       bool tftSwapBytes = _tft->getSwapBytes();
@@ -183,36 +257,41 @@ void TFT_eFEX::drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr)
       bmpFS.seek(seekOffset);
 
       uint16_t padding = (4 - ((w * 3) & 3)) & 3;
-      uint8_t lineBuffer[w * 3 + padding];
+      uint8_t lineBuffer[w * 3 + padding] __attribute__((aligned(4))); // Word aligned for rgb565Row()
 
       for (row = 0; row < h; row++) {
         
+        if (stats) t = micros();
         bmpFS.read(lineBuffer, sizeof(lineBuffer));
-        uint8_t*  bptr = lineBuffer;
-        uint16_t* tptr = (uint16_t*)lineBuffer;
-        // Convert 24 to 16 bit colours
-        for (col = 0; col < w; col++)
-        {
-          b = *bptr++;
-          g = *bptr++;
-          r = *bptr++;
-          *tptr++ = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
-        }
+        if (stats) { stats->readTime += micros() - t; t = micros(); }
+
+        // Convert 24 to 16 bit colours in place
+        if (color_dither) rgb565DitherRow(lineBuffer, (uint16_t*)lineBuffer, w, x, y, true, false);
+        else              rgb565Row(lineBuffer, (uint16_t*)lineBuffer, w, true, false);
+        if (stats) { stats->convertTime += micros() - t; t = micros(); }
 
         // Push the pixel row to screen, pushImage will crop the line if needed
         // y is decremented as the BMP image is drawn bottom up
         if (_spr == nullptr) _tft->pushImage(x, y--, w, 1, (uint16_t*)lineBuffer);
         else                 _spr->pushImage(x, y--, w, 1, (uint16_t*)lineBuffer);
+        if (stats) stats->pushTime += micros() - t;
       }
 
       _tft->setSwapBytes(tftSwapBytes); // Restore original setting
 
-      //Serial.print("Loaded in "); Serial.print(millis() - startTime);
-      //Serial.println(" ms");
+      if (stats)
+      {
+        stats->blocks     = h;
+        stats->pixels     = (uint32_t)w * h;
+        stats->bytesRead  = seekOffset + (uint32_t)h * sizeof(lineBuffer);
+        stats->peakBuffer = sizeof(lineBuffer);
+      }
     }
     else Serial.println("BMP format not recognised.");
   }
   bmpFS.close();
+
+  if (stats) stats->totalTime = micros() - startTime;
 }
 
 // These read 16 and 32-bit types from the file.
@@ -240,7 +319,9 @@ uint32_t TFT_eFEX::read32(fs::File &f) {
 ** Function name:           drawJpeg
 ** Description:             draw a jpeg stored in SPIFFS onto the TFT
 ***************************************************************************************/
-void TFT_eFEX::drawJpeg(String filename, int16_t xpos, int16_t ypos, TFT_eSprite *_spr) {
+void TFT_eFEX::drawJpeg(String filename, int16_t xpos, int16_t ypos, TFT_eSprite *_spr, image_stats_t *stats) {
+
+  if (stats) memset(stats, 0, sizeof(image_stats_t));
 
   if ( (_spr == nullptr) && ((xpos >= _tft->width()) || (ypos >= _tft->height()))) return;
 
@@ -251,112 +332,23 @@ void TFT_eFEX::drawJpeg(String filename, int16_t xpos, int16_t ypos, TFT_eSprite
     return;
   }
 
-  // Open the named file (the Jpeg decoder library will close it after rendering image)
+  // Open the named file
   fs::File jpegFile = SPIFFS.open( filename, "r");    // File handle reference for SPIFFS
   //  File jpegFile = SD.open( filename, FILE_READ);  // or, file handle reference for SD library
- 
-  // Use one of the three following methods to initialise the decoder:
-  //boolean decoded = JpegDec.decodeFsFile(jpegFile); // Pass a SPIFFS file handle to the decoder,
-  //boolean decoded = JpegDec.decodeSdFile(jpegFile); // or pass the SD file handle to the decoder,
-  boolean decoded = JpegDec.decodeFsFile(filename);  // or pass the filename (leading / distinguishes SPIFFS files)
-                                   // Note: the filename can be a String or character array type
-  if (decoded) {
-    // render the image onto the screen at given coordinates
-
-    // retrieve information about the image
-    uint16_t  *pImg;
-    uint16_t mcu_w = JpegDec.MCUWidth;
-    uint16_t mcu_h = JpegDec.MCUHeight;
-    int32_t  max_x = JpegDec.width;
-    int32_t  max_y = JpegDec.height;
-
-    // Jpeg images are draw as a set of image block (tiles) called Minimum Coding Units (MCUs)
-    // Typically these MCUs are 16x16 pixel blocks
-    // Determine the width and height of the right and bottom edge image blocks
-    int32_t min_w = jpg_min(mcu_w, max_x % mcu_w);
-    int32_t min_h = jpg_min(mcu_h, max_y % mcu_h);
-
-    // save the current image block size
-    int32_t win_w = mcu_w;
-    int32_t win_h = mcu_h;
-
-    // record the current time so we can measure how long it takes to draw an image
-    uint32_t drawTime = millis();
-
-    bool tftSwapBytes = _tft->getSwapBytes();
-    bool sprSwapBytes;
-
-    // Retrieve the width and height of the display/Sprite
-    //int32_t disp_w = _tft->width();
-    int32_t disp_h = _tft->height();
-    if (_spr != nullptr)
-    {
-      //disp_w = _spr->width(); 
-      disp_h = _spr->height();
-      sprSwapBytes = _spr->getSwapBytes();
-      _spr->setSwapBytes(false);
-    }
-    _tft->setSwapBytes(false);
-
-    // save the coordinate of the right and bottom edges to assist image cropping
-    // to the screen size
-    max_x += xpos;
-    max_y += ypos;
-
-    // read each MCU block until there are no more
-
-    while ( JpegDec.read())
-    { // Normal byte order read
-      // save a pointer to the image block
-      pImg = JpegDec.pImage;
-
-      // calculate where the image block should be drawn on the screen
-      int mcu_x = JpegDec.MCUx * mcu_w + xpos;
-      int mcu_y = JpegDec.MCUy * mcu_h + ypos;
+  if (!jpegFile) return;
 
-      if ( mcu_y < disp_h )
-      {
-        // check if the image block size needs to be changed for the right edge
-        if (mcu_x + mcu_w <= max_x) win_w = mcu_w;
-        else win_w = min_w;
-
-        // check if the image block size needs to be changed for the bottom edge
-        if (mcu_y + mcu_h <= max_y) win_h = mcu_h;
-        else win_h = min_h;
-
-        // copy pixels into a smaller block
-        if (win_w != mcu_w)
-        {
-          for (int h = 1; h < win_h; h++)
-          {
-            memcpy(pImg + h * win_w, pImg + h * mcu_w, win_w << 1);
-          }
-        }
+  uint32_t startTime = micros();
 
-      if (_spr == nullptr) _tft->pushImage(mcu_x, mcu_y, win_w, win_h, pImg);
-      else _spr->pushImage(mcu_x, mcu_y, win_w, win_h, pImg);
-      }
-      else
-      {
-        JpegDec.abort();
-      }
-    }
+  bool drawn = img_cache_stats.budget && jpegCached(&jpegFile, filename.c_str(), nullptr, jpegFile.size(), xpos, ypos, _spr, stats);
 
-    if (_spr != nullptr) _spr->setSwapBytes(sprSwapBytes); // Restore original setting
-    _tft->setSwapBytes(tftSwapBytes); // Restore original setting
+  if (!drawn) drawn = jpegRender(&jpegFile, nullptr, jpegFile.size(), xpos, ypos, _spr, stats);
 
-    // calculate how long it took to draw the image
-    drawTime = millis() - drawTime; // Calculate the time it took
+  if (!drawn) Serial.println("Jpeg file format not supported!");
+  else if (_spr == nullptr) backgroundAdd(filename.c_str(), nullptr, jpegFile.size(), xpos, ypos);
 
-    // print the results to the serial port
-    //Serial.print  ("Total render time was    : "); Serial.print(drawTime); Serial.println(" ms");
-    //Serial.println("=====================================");
+  jpegFile.close();
 
-  }
-  else
-  {
-    Serial.println("Jpeg file format not supported!");
-  }
+  if (stats) stats->totalTime = micros() - startTime;
 }
 
 
@@ -364,525 +356,1612 @@ void TFT_eFEX::drawJpeg(String filename, int16_t xpos, int16_t ypos, TFT_eSprite
 ** Function name:           drawJpeg
 ** Description:             draw a jpeg stored in FLASH onto the TFT
 ***************************************************************************************/
-void TFT_eFEX::drawJpeg(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, TFT_eSprite *_spr) {
+void TFT_eFEX::drawJpeg(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, TFT_eSprite *_spr, image_stats_t *stats) {
+
+  if (stats) memset(stats, 0, sizeof(image_stats_t));
 
   if ( (_spr == nullptr) && ((xpos >= _tft->width()) || (ypos >= _tft->height()))) return;
-  boolean decoded = JpegDec.decodeArray(arrayname, array_size);
 
-  if (decoded) {
-    // render the image onto the screen at given coordinates
+  uint32_t startTime = micros();
+
+  bool drawn = img_cache_stats.budget && jpegCached(nullptr, nullptr, arrayname, array_size, xpos, ypos, _spr, stats);
+
+  if (!drawn) drawn = jpegRender(nullptr, arrayname, array_size, xpos, ypos, _spr, stats);
+
+  if (!drawn) Serial.println("Jpeg file format not supported!");
+  else if (_spr == nullptr) backgroundAdd(nullptr, arrayname, array_size, xpos, ypos);
+
+  if (stats) stats->totalTime = micros() - startTime;
+}
 
-    // retrieve information about the image
-    uint16_t  *pImg;
-    uint16_t mcu_w = JpegDec.MCUWidth;
-    uint16_t mcu_h = JpegDec.MCUHeight;
-    int32_t  max_x = JpegDec.width;
-    int32_t  max_y = JpegDec.height;
 
-    // Jpeg images are draw as a set of image block (tiles) called Minimum Coding Units (MCUs)
-    // Typically these MCUs are 16x16 pixel blocks
-    // Determine the width and height of the right and bottom edge image blocks
-    int32_t min_w = jpg_min(mcu_w, max_x % mcu_w);
-    int32_t min_h = jpg_min(mcu_h, max_y % mcu_h);
+/***************************************************************************************
+** Function name:           setJpegParallel
+** Description:             decode jpeg arrays with restart markers on two cores
+***************************************************************************************/
+// Used by drawJpeg() for images in an array, e.g. camera frames. Images without restart
+// markers, and images on single core processors, are decoded as normal
+void TFT_eFEX::setJpegParallel(bool enable) {
+  jpeg_parallel = enable;
+}
 
-    // save the current image block size
-    int32_t win_w = mcu_w;
-    int32_t win_h = mcu_h;
 
-    // record the current time so we can measure how long it takes to draw an image
-    uint32_t drawTime = millis();
+/***************************************************************************************
+** Function name:           setColorDither
+** Description:             ordered dither 24 bit colours when converting to 565
+***************************************************************************************/
+// Used by drawBmp() and the ESP32 native decoder (drawJpg(), drawJpgFile() and the
+// scaled versions). The pattern follows the screen (or Sprite) position so images
+// drawn in pieces line up, images put in the image cache use their own position
+void TFT_eFEX::setColorDither(bool enable) {
+  color_dither = enable;
+}
 
-    // Retrieve the width and height of the display/Sprite
-    //int32_t disp_w = _tft->width();
-    int32_t disp_h = _tft->height();
 
-    bool tftSwapBytes = _tft->getSwapBytes();
-    _tft->setSwapBytes(true);
+// Read-ahead ring buffer between a Stream and a jpeg decoder
+typedef struct jpg_stream_t {
+  Stream   *stream;
+  uint8_t  *buf;
+  uint16_t  size;
+  uint16_t  head;       // Index of the next unread byte
+  uint16_t  count;      // Number of unread bytes in the buffer
+  uint32_t  length;     // Image size, 0 if not known
+  uint32_t  remaining;  // Bytes of the image not yet pulled from the stream
+} jpg_stream_t;
 
-    // save the coordinate of the right and bottom edges to assist image cropping
-    // to the screen size
-    max_x += xpos;
-    max_y += ypos;
+/***************************************************************************************
+** Function name:           jpgStreamBegin
+** Description:             allocate the ring buffer for drawJpeg(Stream&, ...)
+***************************************************************************************/
+static bool jpgStreamBegin(jpg_stream_t *ring, Stream *stream, uint32_t length) {
 
-    // read each MCU block until there are no more
+  ring->buf = (uint8_t *)malloc(JPG_STREAM_BUFFER);
+  if (ring->buf == nullptr)
+  {
+    Serial.println(F("Not enough RAM for stream buffer"));
+    return false;
+  }
+  ring->stream = stream;
+  ring->size = JPG_STREAM_BUFFER;
+  ring->head = 0;
+  ring->count = 0;
+  ring->length = length;
+  ring->remaining = length ? length : 0xFFFFFFFF;
+  return true;
+}
 
-    while ( JpegDec.read())
-    { // Normal byte order read
-      // save a pointer to the image block
-      pImg = JpegDec.pImage;
+/***************************************************************************************
+** Function name:           jpgStreamFill
+** Description:             pull more bytes from the stream into the ring buffer
+***************************************************************************************/
+// Fills the free space at the end of the ring buffer. Blocks for up to the Stream
+// timeout, returns false if nothing arrived
+static bool jpgStreamFill(jpg_stream_t *ring) {
+
+  if (ring->remaining == 0) return false;
+
+  uint16_t tail = (ring->head + ring->count) % ring->size;
+  uint32_t want = ring->size - ring->count;
+  if (want > (uint32_t)(ring->size - tail)) want = ring->size - tail;
+  if (want > ring->remaining) want = ring->remaining;
+
+  // Take what has already arrived, or wait for at least one byte
+  int available = ring->stream->available();
+  if (available <= 0) want = 1;
+  else if ((uint32_t)available < want) want = available;
+
+  uint32_t got = ring->stream->readBytes(ring->buf + tail, want);
+  ring->count += got;
+  ring->remaining -= got;
+  return got > 0;
+}
 
-      // calculate where the image block should be drawn on the screen
-      int mcu_x = JpegDec.MCUx * mcu_w + xpos;
-      int mcu_y = JpegDec.MCUy * mcu_h + ypos;
+/***************************************************************************************
+** Function name:           jpgStreamRead
+** Description:             read (or skip if buf is nullptr) len bytes through the ring buffer
+***************************************************************************************/
+// Returns the number of bytes read, less than len on a time-out or at the end of the image
+static uint32_t jpgStreamRead(jpg_stream_t *ring, uint8_t *buf, uint32_t len) {
 
-      if ( mcu_y < disp_h )
-      {
-        // check if the image block size needs to be changed for the right edge
-        if (mcu_x + mcu_w <= max_x) win_w = mcu_w;
-        else win_w = min_w;
+  uint32_t done = 0;
 
-        // check if the image block size needs to be changed for the bottom edge
-        if (mcu_y + mcu_h <= max_y) win_h = mcu_h;
-        else win_h = min_h;
+  while (done < len)
+  {
+    if ((ring->count == 0) && !jpgStreamFill(ring)) break;
+
+    // Largest contiguous run available in the ring buffer
+    uint32_t n = len - done;
+    if (n > ring->count) n = ring->count;
+    if (n > (uint32_t)(ring->size - ring->head)) n = ring->size - ring->head;
+    if (buf) memcpy(buf + done, ring->buf + ring->head, n);
+    ring->head = (ring->head + n) % ring->size;
+    ring->count -= n;
+    done += n;
+  }
+  return done;
+}
 
-        // copy pixels into a smaller block
-        if (win_w != mcu_w)
-        {
-          for (int h = 1; h < win_h; h++)
-          {
-            memcpy(pImg + h * win_w, pImg + h * mcu_w, win_w << 1);
-          }
-        }
+/***************************************************************************************
+** Function name:           jpgStreamEnd
+** Description:             free the ring buffer, leaving the stream at the end of the image
+***************************************************************************************/
+// Any bytes of a known length image that the decoder did not use are discarded
+static void jpgStreamEnd(jpg_stream_t *ring) {
 
-        if (_spr == nullptr)  _tft->pushImage(mcu_x, mcu_y, win_w, win_h, pImg);
-        else _spr->pushImage(mcu_x, mcu_y, win_w, win_h, pImg);
-      }
-      else
+  if (ring->length)
+  {
+    uint32_t timeout = millis();
+    while (ring->remaining && (millis() - timeout < START_TIMEOUT))
+    {
+      if (ring->stream->read() >= 0)
       {
-        JpegDec.abort();
+        ring->remaining--;
+        timeout = millis();
       }
+      else delay(0);
     }
+  }
+  free(ring->buf);
+}
 
-    _tft->setSwapBytes(tftSwapBytes); // Restore original setting
+/***************************************************************************************
+** Function name:           drawJpeg
+** Description:             draw a jpeg arriving on a Stream onto the TFT or a Sprite
+***************************************************************************************/
+// Bytes are pulled through a JPG_STREAM_BUFFER byte ring buffer as the decoder needs
+// them, so the whole image never has to be held in RAM. length is 0 if not known
+// e.g. fex.drawJpeg(client, jpegLength, 0, 0);
+// The bundled decoder is used on the ESP32 too. The native decoder cannot draw
+// grayscale images, and by the time it reports that the bytes are gone from the Stream
+bool TFT_eFEX::drawJpeg(Stream &stream, uint32_t length, int16_t xpos, int16_t ypos, TFT_eSprite *_spr, image_stats_t *stats) {
+
+  if (stats) memset(stats, 0, sizeof(image_stats_t));
+
+  uint32_t startTime = micros();
+
+  jpg_stream_t ring;
+  if (!jpgStreamBegin(&ring, &stream, length)) return false;
+
+  bool drawn = jpegRender(nullptr, nullptr, ring.remaining, xpos, ypos, _spr, stats, 0, 0, 0, false, 0, 0, &ring);
+
+  jpgStreamEnd(&ring);
+
+  if (stats)
+  {
+    stats->peakBuffer += JPG_STREAM_BUFFER;
+    stats->totalTime = micros() - startTime;
+  }
+  return drawn;
+}
+
+
+// Source and destination for the bundled decoder input and output functions
+typedef struct {
+  fs::File      *file;      // File to read from, nullptr for an array
+  jpg_stream_t  *stream;    // Stream to read from, nullptr for a file or array
+  const uint8_t *data;      // Array to read from
+  uint32_t       len;       // Bytes left in the source
+  TFT_eFEX      *fex;
+  TFT_eSprite   *spr;       // Sprite to draw in, nullptr for the TFT
+  int16_t        x, y;      // Image position on the TFT or Sprite
+  uint16_t       left, top; // Crop window (in scaled pixels)
+  uint16_t       right, bottom;
+  bool           rgb332;    // One byte RGB332 pixels for an 8 bit Sprite
+  uint16_t      *buf;       // Decode into this crop window sized buffer instead, nullptr to draw
+  bool           inTransaction;
+  image_stats_t *stats;
+} jpeg_io_t;
+
+/***************************************************************************************
+** Function name:           jpegInput
+** Description:             bundled decoder input function, reads a file, Stream or array
+***************************************************************************************/
+// buf is nullptr when the decoder wants bytes skipped
+static uint32_t jpegInput(void *src, uint8_t *buf, uint32_t len) {
 
-    // calculate how long it took to draw the image
-    drawTime = millis() - drawTime; // Calculate the time it took
+  jpeg_io_t *io = (jpeg_io_t *)src;
+  uint32_t t = io->stats ? micros() : 0;
 
-    // print the results to the serial port
-    //Serial.print  ("Total render time was    : "); Serial.print(drawTime); Serial.println(" ms");
-    //Serial.println("=====================================");
+  if (len > io->len) len = io->len;
 
+  if (io->stream) len = jpgStreamRead(io->stream, buf, len);
+  else if (io->file)
+  {
+    if (buf) len = io->file->read(buf, len);
+    else io->file->seek(len, fs::SeekCur);
   }
   else
   {
-    Serial.println("Jpeg file format not supported!");
+    if (buf) memcpy_P(buf, io->data, len);
+    io->data += len;
   }
-}
+  io->len -= len;
 
+  if (io->stats)
+  {
+    io->stats->readTime += micros() - t;
+    io->stats->bytesRead += len;
+  }
+  return len;
+}
 
 /***************************************************************************************
-** Function name:           jpegInfo
-** Description:             Print information decoded from the Jpeg image
+** Function name:           jpegOutput
+** Description:             bundled decoder output function, pushes one MCU of pixels
 ***************************************************************************************/
-void TFT_eFEX::jpegInfo(String filename) {
-  // Note: ESP32 passes "open" test even if file does not exist, whereas ESP8266 returns NULL
-  if ( !SPIFFS.exists(filename) )
+// Pixels arrive in panel byte order (or as RGB332 bytes), x and y are in the (scaled) image
+bool TFT_eFEX::jpegOutput(void *dev, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *pixels) {
+
+  jpeg_io_t *io = (jpeg_io_t *)dev;
+  uint32_t t = io->stats ? micros() : 0;
+
+  // Crop to the window, the decoder only sends MCUs that overlap it
+  int16_t x0 = (x < io->left) ? io->left : x;
+  int16_t y0 = (y < io->top)  ? io->top  : y;
+  int16_t x1 = (x + w > io->right)  ? io->right  : x + w;
+  int16_t y1 = (y + h > io->bottom) ? io->bottom : y + h;
+  if ((x1 <= x0) || (y1 <= y0)) return true;
+  uint16_t win_w = x1 - x0;
+  uint16_t win_h = y1 - y0;
+
+  // Close up the pixels if an edge is cropped
+  uint8_t  bytes = io->rgb332 ? 1 : 2;
+  uint8_t *p = (uint8_t *)pixels;
+  if ((win_w != w) || (y0 != y))
   {
-    Serial.println(F(" Jpeg file not found")); // Can comment out if not needed
-    return;
+    for (uint16_t row = 0; row < win_h; row++)
+    {
+      memmove(p + row * win_w * bytes, p + ((y0 - y + row) * w + x0 - x) * bytes, win_w * bytes);
+    }
   }
 
-  // Open the named file (the Jpeg decoder library abort will close it after reading image info)
-  fs::File jpegFile = SPIFFS.open( filename, "r");    // File handle reference for SPIFFS
-  //  File jpegFile = SD.open( filename, FILE_READ);  // or, file handle reference for SD library
- 
-  // Use one of the three following methods to initialise the decoder:
-  //boolean decoded = JpegDec.decodeFsFile(jpegFile); // Pass a SPIFFS file handle to the decoder,
-  //boolean decoded = JpegDec.decodeSdFile(jpegFile); // or pass the SD file handle to the decoder,
-  boolean decoded = JpegDec.decodeFsFile(filename);  // or pass the filename (leading / distinguishes SPIFFS files)
+  if (io->buf)
+  {
+    uint16_t  stride = io->right - io->left;
+    uint16_t *out = io->buf + (y0 - io->top) * stride + (x0 - io->left);
+    for (uint16_t row = 0; row < win_h; row++) memcpy(out + row * stride, pixels + row * win_w, win_w << 1);
+  }
+  else if (io->rgb332) io->fex->pushPanelImage(io->x + x0, io->y + y0, win_w, win_h, p, io->spr);
+  else io->fex->pushPanelImage(io->x + x0, io->y + y0, win_w, win_h, pixels, io->spr, io->inTransaction);
 
-  static const char line[] PROGMEM =  "===============";
-  if (decoded) {
-    Serial.println(FPSTR(line));
-    Serial.println(F("JPEG image info"));
-    Serial.println(FPSTR(line));
-    Serial.print  (F("Width      :")); Serial.println(JpegDec.width);
-    Serial.print  (F("Height     :")); Serial.println(JpegDec.height);
-    Serial.print  (F("Components :")); Serial.println(JpegDec.comps);
-    Serial.print  (F("MCU / row  :")); Serial.println(JpegDec.MCUSPerRow);
-    Serial.print  (F("MCU / col  :")); Serial.println(JpegDec.MCUSPerCol);
-    Serial.print  (F("Scan type  :")); Serial.println(JpegDec.scanType);
-    Serial.print  (F("MCU width  :")); Serial.println(JpegDec.MCUWidth);
-    Serial.print  (F("MCU height :")); Serial.println(JpegDec.MCUHeight);
-    Serial.println(FPSTR(line));
-    Serial.println("");
-    JpegDec.abort();    // Close file and tidy up
+  if (io->stats)
+  {
+    io->stats->pushTime += micros() - t;
+    io->stats->blocks++;
+    io->stats->pixels += win_w * win_h;
   }
+  return true;
 }
 
-
 /***************************************************************************************
-** Function name:           jpegInfo
-** Description:             Print information decoded from the Jpeg image
+** Function name:           jpegRender
+** Description:             decode a jpeg file or array with the bundled decoder
 ***************************************************************************************/
-void TFT_eFEX::jpegInfo(const uint8_t arrayname[], uint32_t array_size) {
+// The image is drawn at 1/(2^scale) size, cropped to maxWidth x maxHeight (0 = no crop)
+// starting at offX,offY (scaled pixels) and clipped to the TFT or Sprite. MCUs that are
+// not visible are not converted or drawn. 8 bit Sprites are written with RGB332 pixels
+// straight from the decoder. If stats is not nullptr the decode and push times and
+// counts are added to it
+bool TFT_eFEX::jpegRender(fs::File *file, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos, TFT_eSprite *_spr,
+                          image_stats_t *stats, uint8_t scale, uint16_t maxWidth, uint16_t maxHeight, bool inTransaction,
+                          uint16_t offX, uint16_t offY, jpg_stream_t *stream) {
+
+  // About 10 kbytes, allocated so it does not use up the stack
+  TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+  if (jpeg == nullptr)
+  {
+    Serial.println(F("Not enough RAM for Jpeg decoder"));
+    return false;
+  }
 
-  boolean decoded = JpegDec.decodeArray(arrayname, array_size);
-  static const char line[] PROGMEM =  "===============";
+  jpeg_io_t io;
+  io.file = file;
+  io.stream = stream;
+  io.data = data;
+  io.len  = len;
+  io.fex  = this;
+  io.spr  = _spr;
+  io.x    = xpos - offX;
+  io.y    = ypos - offY;
+  io.rgb332 = (_spr != nullptr) && (_spr->getColorDepth() == 8);
+  io.buf  = nullptr;
+  io.inTransaction = inTransaction;
+  io.stats = stats;
+
+  uint32_t startTime = micros();
+  uint32_t readTime = 0, pushTime = 0;
+  if (stats)
+  {
+    readTime = stats->readTime;
+    pushTime = stats->pushTime;
+    stats->peakBuffer = sizeof(TFT_eFEX_Jpeg);
+  }
 
-  if (decoded) {
-    Serial.println(FPSTR(line));
-    Serial.println(F("JPEG image info"));
-    Serial.println(FPSTR(line));
-    Serial.print  (F("Width      :")); Serial.println(JpegDec.width);
-    Serial.print  (F("Height     :")); Serial.println(JpegDec.height);
-    Serial.print  (F("Components :")); Serial.println(JpegDec.comps);
-    Serial.print  (F("MCU / row  :")); Serial.println(JpegDec.MCUSPerRow);
-    Serial.print  (F("MCU / col  :")); Serial.println(JpegDec.MCUSPerCol);
-    Serial.print  (F("Scan type  :")); Serial.println(JpegDec.scanType);
-    Serial.print  (F("MCU width  :")); Serial.println(JpegDec.MCUWidth);
-    Serial.print  (F("MCU height :")); Serial.println(JpegDec.MCUHeight);
-    Serial.println(FPSTR(line));
-    Serial.println("");
-    JpegDec.abort();    // Close file and tidy up
+  fjpg_result_t result = jpeg->prepare(jpegInput, &io);
+
+  if (result == FJPG_OK)
+  {
+    jpeg_width  = jpeg->width;
+    jpeg_height = jpeg->height;
+
+    int32_t img_w = (jpeg->width  + (1 << scale) - 1) >> scale;
+    int32_t img_h = (jpeg->height + (1 << scale) - 1) >> scale;
+    if (maxWidth  && (img_w > offX + maxWidth))  img_w = offX + maxWidth;
+    if (maxHeight && (img_h > offY + maxHeight)) img_h = offY + maxHeight;
+    io.left   = offX;
+    io.top    = offY;
+    io.right  = img_w;
+    io.bottom = img_h;
+
+    // Only decode the part of the image that lands on the TFT or Sprite
+    int32_t disp_w = (_spr == nullptr) ? _tft->width()  : _spr->width();
+    int32_t disp_h = (_spr == nullptr) ? _tft->height() : _spr->height();
+    int32_t x0 = (io.x < -offX) ? -io.x : offX;
+    int32_t y0 = (io.y < -offY) ? -io.y : offY;
+    int32_t x1 = (io.x + img_w > disp_w) ? disp_w - io.x : img_w;
+    int32_t y1 = (io.y + img_h > disp_h) ? disp_h - io.y : img_h;
+
+    if ((x1 > x0) && (y1 > y0))
+    {
+      jpeg->setClip(x0, y0, x1 - x0, y1 - y0);
+      jpeg->swapBytes = true; // Panel byte order, as used by pushColors() and 16 bit Sprites
+      jpeg->rgb332 = io.rgb332;
+      // Images in memory with restart markers can be decoded in strips on two cores
+      if (jpeg_parallel && (data != nullptr))
+      {
+        result = jpeg->decodeParallel(data, len, jpegOutput, &io, scale);
+        if (stats) stats->bytesRead = len; // Strips are read straight from the array
+      }
+      else result = jpeg->decode(jpegOutput, &io, scale);
+    }
+  }
+
+  // The bundled decoder converts colours as it decodes, so that is counted as decode time
+  if (stats)
+  {
+    stats->decodeTime += (micros() - startTime) - (stats->readTime - readTime) - (stats->pushTime - pushTime);
   }
+
+  free(jpeg);
+
+  return (result == FJPG_OK);
 }
 
 
 /***************************************************************************************
-** Function name:           drawProgressBar
-** Description:             Draw a progress bar - increasing percentage only
+** Function name:           pushPanelImage
+** Description:             push 565 pixels in panel byte order to the TFT or a Sprite
 ***************************************************************************************/
-void TFT_eFEX::drawProgressBar(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t percent, uint16_t frameColor, uint16_t barColor) {
-  if (percent == 0) {
-    _tft->fillRoundRect(x, y, w, h, 3, TFT_BLACK);
+// The block is clipped to the TFT or Sprite. Pixels are already in the byte order
+// the panel expects (MSB first) so the swap bytes setting is never used or changed
+void TFT_eFEX::pushPanelImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, TFT_eSprite *_spr, bool inTransaction) {
+
+  int32_t dw = w, dh = h;
+  int32_t disp_w = (_spr == nullptr) ? _tft->width()  : _spr->width();
+  int32_t disp_h = (_spr == nullptr) ? _tft->height() : _spr->height();
+
+  if (x < 0) { dw += x; data -= x; x = 0; }
+  if (y < 0) { dh += y; data -= y * w; y = 0; }
+  if (x + dw > disp_w) dw = disp_w - x;
+  if (y + dh > disp_h) dh = disp_h - y;
+
+  if ((dw < 1) || (dh < 1)) return;
+
+  if (_spr == nullptr)
+  {
+    if (!inTransaction) _tft->startWrite();
+    _tft->setAddrWindow(x, y, dw, dh);
+    while (dh--)
+    {
+      _tft->pushColors(data, dw, false);
+      data += w;
+    }
+    if (!inTransaction) _tft->endWrite();
+  }
+  else if (_spr->getColorDepth() == 16)
+  {
+    // 16 bit Sprites store pixels in panel byte order so lines are copied straight in
+    uint16_t *img = (uint16_t *)_spr->getPointer() + x + y * disp_w;
+    while (dh--)
+    {
+      memcpy(img, data, dw << 1);
+      img  += disp_w;
+      data += w;
+    }
+  }
+  else
+  {
+    // Other colour depths need the Sprite to convert each pixel
+    for (int32_t row = 0; row < dh; row++)
+    {
+      for (int32_t col = 0; col < dw; col++)
+      {
+        uint16_t color = data[col + row * w];
+        _spr->drawPixel(x + col, y + row, (color >> 8) | (color << 8));
+      }
+    }
   }
-  uint8_t margin = 2;
-  uint16_t barHeight = h - 2 * margin;
-  uint16_t barWidth  = w - 2 * margin;
-  _tft->drawRoundRect(x, y, w, h, 3, frameColor);
-  _tft->fillRect(x + margin, y + margin, barWidth * percent / 100.0, barHeight, barColor);
 }
 
 
 /***************************************************************************************
-** Function name:           luminance
-** Description:             return a 16 bit colour with reduced luminance
+** Function name:           pushPanelImage
+** Description:             push RGB332 pixels to an 8 bit Sprite
 ***************************************************************************************/
-uint16_t TFT_eFEX::luminance(uint16_t color, uint8_t luminance)
-{
-  // Extract rgb colours and stretch range to 0 - 255
-  uint16_t r = (color & 0xF800) >> 8; r |= (r >> 5);
-  uint16_t g = (color & 0x07E0) >> 3; g |= (g >> 6);
-  uint16_t b = (color & 0x001F) << 3; b |= (b >> 5);
+// The block is clipped to the Sprite and the lines are copied straight in
+void TFT_eFEX::pushPanelImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t *data, TFT_eSprite *_spr) {
 
-  b = ((b * (uint16_t)luminance + 255) >> 8) & 0x00F8;
-  g = ((g * (uint16_t)luminance + 255) >> 8) & 0x00FC;
-  r = ((r * (uint16_t)luminance + 255) >> 8) & 0x00F8;
+  int32_t dw = w, dh = h;
+  int32_t disp_w = _spr->width();
+  int32_t disp_h = _spr->height();
 
-  return (r << 8) | (g << 3) | (b >> 3);
+  if (x < 0) { dw += x; data -= x; x = 0; }
+  if (y < 0) { dh += y; data -= y * w; y = 0; }
+  if (x + dw > disp_w) dw = disp_w - x;
+  if (y + dh > disp_h) dh = disp_h - y;
+
+  if ((dw < 1) || (dh < 1)) return;
+
+  uint8_t *img = (uint8_t *)_spr->getPointer() + x + y * disp_w;
+  while (dh--)
+  {
+    memcpy(img, data, dw);
+    img  += disp_w;
+    data += w;
+  }
 }
 
 
 /***************************************************************************************
-** Function name:           luminance
-** Description:             return a 16 bit colour from an RGB with reduced luminance
+** Function name:           setImageCache
+** Description:             set the decoded image cache budget, 0 turns the cache off
 ***************************************************************************************/
-uint16_t TFT_eFEX::luminance(uint8_t red, uint8_t green, uint8_t blue, uint8_t luminance)
-{
-  uint16_t b = (((uint16_t)blue  * (uint16_t)luminance + 255) >> 8) & 0x00F8;
-  uint16_t g = (((uint16_t)green * (uint16_t)luminance + 255) >> 8) & 0x00FC;
-  uint16_t r = (((uint16_t)red   * (uint16_t)luminance + 255) >> 8) & 0x00F8;
+// The budget is in bytes of pixels (2 per pixel), the counters are reset
+void TFT_eFEX::setImageCache(uint32_t budget) {
+  clearImageCache();
+  memset(&img_cache_stats, 0, sizeof(image_cache_stats_t));
+  img_cache_stats.budget = budget;
+}
 
-  return (r << 8) | (g << 3) | (b >> 3);
+
+/***************************************************************************************
+** Function name:           clearImageCache
+** Description:             free all the cached images, the budget is kept
+***************************************************************************************/
+void TFT_eFEX::clearImageCache(void) {
+  while (img_cache) cacheRemove(img_cache);
 }
 
 
 /***************************************************************************************
-** Function name:           rainbowColor
-** Description:             Return a 16 bit rainbow colour
+** Function name:           getImageCacheStats
+** Description:             copy the image cache counters
 ***************************************************************************************/
+void TFT_eFEX::getImageCacheStats(image_cache_stats_t *stats) {
+  if (stats) *stats = img_cache_stats;
+}
 
-  // If 'spectrum' is in the range 0-159 it is converted to a spectrum colour
-  // from 0 = red through to 127 = blue to 159 = violet
-  // Extending the range to 0-191 adds a further violet to red band
- 
-uint16_t TFT_eFEX::rainbowColor(uint8_t spectrum)
-{
-  spectrum = spectrum%192;
-  
-  uint8_t red   = 0; // Red is the top 5 bits of a 16 bit colour spectrum
-  uint8_t green = 0; // Green is the middle 6 bits, but only top 5 bits used here
-  uint8_t blue  = 0; // Blue is the bottom 5 bits
 
-  uint8_t sector = spectrum >> 5;
-  uint8_t amplit = spectrum & 0x1F;
+/***************************************************************************************
+** Function name:           cacheFind
+** Description:             look up an image in the cache and make it most recently used
+***************************************************************************************/
+// Files are matched by path, size and last write time, arrays by address and size.
+// An older copy of an image that has changed is dropped. The hits and misses counters
+// are only changed if count is true, so restoreBackground() does not skew them
+image_cache_entry_t *TFT_eFEX::cacheFind(const char *path, const uint8_t *data, uint32_t size, uint32_t mtime, bool count) {
 
-  switch (sector)
+  image_cache_entry_t *prev = nullptr;
+  for (image_cache_entry_t *entry = img_cache; entry; prev = entry, entry = entry->next)
   {
-    case 0:
-      red   = 0x1F;
-      green = amplit; // Green ramps up
-      blue  = 0;
-      break;
-    case 1:
-      red   = 0x1F - amplit; // Red ramps down
-      green = 0x1F;
-      blue  = 0;
-      break;
-    case 2:
-      red   = 0;
-      green = 0x1F;
-      blue  = amplit; // Blue ramps up
-      break;
-    case 3:
-      red   = 0;
-      green = 0x1F - amplit; // Green ramps down
-      blue  = 0x1F;
-      break;
-    case 4:
-      red   = amplit; // Red ramps up
-      green = 0;
-      blue  = 0x1F;
-      break;
-    case 5:
-      red   = 0x1F;
-      green = 0;
-      blue  = 0x1F - amplit; // Blue ramps down
+    if (path ? (!entry->path || strcmp(entry->path, path)) : (entry->data != data)) continue;
+
+    if ((entry->size != size) || (entry->mtime != mtime))
+    {
+      cacheRemove(entry);
       break;
+    }
+
+    if (prev)
+    {
+      prev->next  = entry->next;
+      entry->next = img_cache;
+      img_cache   = entry;
+    }
+    if (count) img_cache_stats.hits++;
+    return entry;
   }
 
-  return red << 11 | green << 6 | blue;
+  if (count) img_cache_stats.misses++;
+  return nullptr;
 }
 
 
 /***************************************************************************************
-** Function name:           listSPIFFS
-** Description:             Listing SPIFFS files
+** Function name:           cacheAdd
+** Description:             make room for and add a w x h image to the cache
 ***************************************************************************************/
-#ifdef ESP8266
-void TFT_eFEX::listSPIFFS(void) {
-  Serial.println(F("\r\nListing SPIFFS files:"));
+// Returns nullptr if the image is bigger than the budget or there is not enough RAM.
+// The pixels are not set, the caller decodes into them (or calls cacheRemove())
+image_cache_entry_t *TFT_eFEX::cacheAdd(const char *path, const uint8_t *data, uint32_t size, uint32_t mtime, uint16_t w, uint16_t h) {
 
-  fs::Dir dir = SPIFFS.openDir("/"); // Root directory
+  uint32_t bytes = (uint32_t)w * h * 2;
+  if (bytes == 0 || bytes > img_cache_stats.budget)
+  {
+    img_cache_stats.rejected++;
+    return nullptr;
+  }
 
-  static const char line[] PROGMEM =  "=================================================";
-  Serial.println(FPSTR(line));
-  Serial.println(F("  File name                              Size"));
-  Serial.println(FPSTR(line));
+  // Drop the least recently used images (at the end of the list) until it fits
+  while (img_cache_stats.bytes + bytes > img_cache_stats.budget)
+  {
+    image_cache_entry_t *last = img_cache;
+    while (last->next) last = last->next;
+    cacheRemove(last);
+    img_cache_stats.evictions++;
+  }
 
-  while (dir.next()) {
-    String fileName = dir.fileName();
-    Serial.print(fileName);
-    int spaces = 33 - fileName.length(); // Tabulate nicely
-    if (spaces < 1) spaces = 1;
-    while (spaces--) Serial.print(" ");
+  image_cache_entry_t *entry = (image_cache_entry_t *)malloc(sizeof(image_cache_entry_t));
+  if (entry == nullptr)
+  {
+    img_cache_stats.rejected++;
+    return nullptr;
+  }
 
-    fs::File f = dir.openFile("r");
-    String fileSize = (String) f.size();
-    spaces = 10 - fileSize.length(); // Tabulate nicely
-    if (spaces < 1) spaces = 1;
-    while (spaces--) Serial.print(" ");
-    Serial.println(fileSize + " bytes");
+  // Pixels go in PSRAM if there is any, it is plenty fast enough for pushing to the TFT
+#ifdef ESP32
+  entry->pixels = (uint16_t *)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+#else
+  entry->pixels = (uint16_t *)malloc(bytes);
+#endif
+  entry->path = path ? strdup(path) : nullptr;
+
+  if ((entry->pixels == nullptr) || (path && (entry->path == nullptr)))
+  {
+    free(entry->pixels);
+    free(entry->path);
+    free(entry);
+    img_cache_stats.rejected++;
+    return nullptr;
   }
 
-  Serial.println(FPSTR(line));
-  Serial.println();
-  delay(1000);
+  entry->data   = data;
+  entry->size   = size;
+  entry->mtime  = mtime;
+  entry->width  = w;
+  entry->height = h;
+  entry->next   = img_cache;
+  img_cache     = entry;
+
+  img_cache_stats.entries++;
+  img_cache_stats.bytes += bytes;
+
+  return entry;
 }
 
-//====================================================================================
 
-#elif defined ESP32
-// TODO: add sub directories
-void TFT_eFEX::listSPIFFS(void) {
-  Serial.println(F("\r\nListing SPIFFS files:"));
-  static const char line[] PROGMEM =  "=================================================";
+/***************************************************************************************
+** Function name:           cacheRemove
+** Description:             unlink and free a cached image
+***************************************************************************************/
+void TFT_eFEX::cacheRemove(image_cache_entry_t *entry) {
 
-  Serial.println(FPSTR(line));
-  Serial.println(F("  File name                              Size"));
-  Serial.println(FPSTR(line));
+  image_cache_entry_t **link = &img_cache;
+  while (*link && (*link != entry)) link = &(*link)->next;
+  if (*link == nullptr) return;
+  *link = entry->next;
 
-  fs::File root = SPIFFS.open("/");
-  if (!root) {
-    Serial.println(F("Failed to open directory"));
-    return;
+  img_cache_stats.entries--;
+  img_cache_stats.bytes -= (uint32_t)entry->width * entry->height * 2;
+
+  free(entry->pixels);
+  free(entry->path);
+  free(entry);
+}
+
+
+/***************************************************************************************
+** Function name:           cacheDraw
+** Description:             push a cached image to the TFT or a Sprite
+***************************************************************************************/
+void TFT_eFEX::cacheDraw(image_cache_entry_t *entry, int16_t x, int16_t y, TFT_eSprite *_spr, image_stats_t *stats) {
+
+  uint32_t t = stats ? micros() : 0;
+
+  pushPanelImage(x, y, entry->width, entry->height, entry->pixels, _spr);
+
+  if (stats)
+  {
+    stats->pushTime += micros() - t;
+    stats->pixels   += (uint32_t)entry->width * entry->height;
   }
-  if (!root.isDirectory()) {
-    Serial.println(F("Not a directory"));
-    return;
+}
+
+
+/***************************************************************************************
+** Function name:           jpegCached
+** Description:             draw a jpeg from the image cache, decoding it into the cache if needed
+***************************************************************************************/
+// Returns false if the image is not cached and could not be added, the caller then
+// draws it with jpegRender(). A file is left at the start in that case
+bool TFT_eFEX::jpegCached(fs::File *file, const char *path, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos,
+                          TFT_eSprite *_spr, image_stats_t *stats) {
+
+  uint32_t mtime = file ? file->getLastWrite() : 0;
+
+  image_cache_entry_t *entry = cacheFind(path, data, len, mtime);
+
+  if (entry == nullptr)
+  {
+    TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+    if (jpeg == nullptr) return false;
+
+    jpeg_io_t io;
+    io.file   = file;
+    io.stream = nullptr;
+    io.data   = data;
+    io.len    = len;
+    io.fex    = this;
+    io.spr    = nullptr;
+    io.x      = 0;
+    io.y      = 0;
+    io.rgb332 = false;
+    io.inTransaction = false;
+    io.stats  = stats;
+
+    uint32_t startTime = micros();
+    uint32_t readTime = stats ? stats->readTime : 0;
+
+    // The whole image is decoded into the cache, then pushed from there
+    if (jpeg->prepare(jpegInput, &io) == FJPG_OK)
+    {
+      entry = cacheAdd(path, data, len, mtime, jpeg->width, jpeg->height);
+      if (entry)
+      {
+        io.left   = 0;
+        io.top    = 0;
+        io.right  = jpeg->width;
+        io.bottom = jpeg->height;
+        io.buf    = entry->pixels;
+        jpeg->swapBytes = true;
+        if (jpeg->decode(jpegOutput, &io) != FJPG_OK)
+        {
+          cacheRemove(entry);
+          entry = nullptr;
+        }
+      }
+    }
+
+    if (stats && entry)
+    {
+      stats->decodeTime += (micros() - startTime) - (stats->readTime - readTime);
+      stats->peakBuffer  = sizeof(TFT_eFEX_Jpeg);
+    }
+
+    free(jpeg);
+
+    if (entry == nullptr)
+    {
+      if (file) file->seek(0);
+      return false;
+    }
   }
 
-  fs::File file = root.openNextFile();
-  while (file) {
+  jpeg_width  = entry->width;
+  jpeg_height = entry->height;
 
-    if (file.isDirectory()) {
-      Serial.print("DIR : ");
-      String fileName = file.name();
-      Serial.print(fileName);
-    } else {
-      String fileName = file.name();
-      Serial.print("  " + fileName);
-      // File path can be 31 characters maximum in SPIFFS
-      int spaces = 33 - fileName.length(); // Tabulate nicely
-      if (spaces < 1) spaces = 1;
-      while (spaces--) Serial.print(" ");
-      String fileSize = (String) file.size();
-      spaces = 10 - fileSize.length(); // Tabulate nicely
-      if (spaces < 1) spaces = 1;
-      while (spaces--) Serial.print(" ");
-      Serial.println(fileSize + " bytes");
+  cacheDraw(entry, xpos, ypos, _spr, stats);
+
+  return true;
+}
+
+
+// Jpeg output state for drawJpegDithered()
+typedef struct {
+  epd_bitmap_t *bitmap;
+  uint8_t   method;
+  int16_t   x, y;          // Image position in the bitmap
+  int16_t   left, top;     // Visible part of the image
+  int16_t   right, bottom;
+  uint8_t  *band;          // One MCU row of luma for DITHER_DIFFUSION, as MCUs arrive left to right
+  int16_t   bandTop;       // Image row of the first band line, -1 if the band is empty
+  uint8_t   bandH;
+  int16_t  *err;           // Error diffusion row, right - left + 2 entries
+} dither_io_t;
+
+/***************************************************************************************
+** Function name:           ditherRow
+** Description:             dither a row of 8 bit gray pixels into an ePaper bitmap
+***************************************************************************************/
+// The row starts at bx,by in the bitmap and must fit inside it. err is the error
+// diffusion row for DITHER_DIFFUSION (n + 2 entries, zeroed for the first row), rows
+// must then be dithered in order. Floyd-Steinberg with one row: err[i + 1] holds the
+// error for pixel i brought down from the row above, and once used it is replaced by
+// the error for pixel i of the row below
+static void ditherRow(epd_bitmap_t *bm, uint8_t method, int32_t bx, int32_t by, const uint8_t *gray, uint16_t n, int16_t *err) {
+
+  uint8_t  levels = (1 << bm->bits) - 1;
+  uint8_t  ppb = 8 / bm->bits; // Pixels per byte
+  uint8_t *row = bm->buf + by * ((bm->width * bm->bits + 7) >> 3);
+
+  // Thresholds for this row, scaled so (v * levels * 16 + t) / 4080 rounds to a level
+  uint16_t t[4];
+  for (uint8_t i = 0; i < 4; i++) t[i] = ditherBayer[by & 3][i] * 255 + 127;
+
+  int16_t right = 0, carry = 0;
+
+  for (uint16_t i = 0; i < n; i++)
+  {
+    int32_t  px = bx + i;
+    uint8_t  q;
+
+    if (method == DITHER_ORDERED)
+    {
+      q = (gray[i] * levels * 16 + t[px & 3]) / 4080;
+    }
+    else
+    {
+      int16_t v = gray[i] + right + err[i + 1];
+      q = (v <= 0) ? 0 : (v >= 255) ? levels : (v * levels + 127) / 255;
+      int16_t e = v - (q * 255) / levels;
+      err[i]     += (e * 3) / 16;
+      err[i + 1]  = (e * 5) / 16 + carry;
+      carry       = e / 16;
+      right       = (e * 7) / 16;
     }
 
-    file = root.openNextFile();
+    uint8_t  shift = (ppb - 1 - (px % ppb)) * bm->bits;
+    uint8_t *p = row + px / ppb;
+    *p = (*p & ~(levels << shift)) | (q << shift);
   }
+}
 
-  Serial.println(FPSTR(line));
-  Serial.println();
-  delay(1000);
+/***************************************************************************************
+** Function name:           ditherFlush
+** Description:             dither the rows held in the band buffer
+***************************************************************************************/
+static void ditherFlush(dither_io_t *d) {
+
+  if (d->bandTop < 0) return;
+
+  uint16_t n = d->right - d->left;
+  for (int16_t r = d->bandTop; (r < d->bandTop + d->bandH) && (r < d->bottom); r++)
+  {
+    if (r < d->top) continue;
+    ditherRow(d->bitmap, d->method, d->x + d->left, d->y + r, d->band + (r - d->bandTop) * n, n, d->err);
+  }
+  d->bandTop = -1;
 }
 
-#else
+/***************************************************************************************
+** Function name:           jpegDitherOutput
+** Description:             bundled decoder output function for drawJpegDithered()
+***************************************************************************************/
+// Pixels are 8 bit luma. Ordered dithering only depends on the pixel position so MCUs
+// are dithered as they arrive. Error diffusion needs whole rows in order, so a row of
+// MCUs is gathered first
+static bool jpegDitherOutput(void *dev, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *pixels) {
 
-void TFT_eFEX::listSPIFFS(void) {}
+  dither_io_t *d = (dither_io_t *)dev;
+  uint8_t *gray = (uint8_t *)pixels;
 
-#endif
+  int16_t x0 = (x < d->left) ? d->left : x;
+  int16_t x1 = (x + w > d->right) ? d->right : x + w;
+  if (x1 <= x0) return true;
+
+  if (d->method == DITHER_ORDERED)
+  {
+    for (int16_t r = y; (r < y + h) && (r < d->bottom); r++)
+    {
+      if (r < d->top) continue;
+      ditherRow(d->bitmap, d->method, d->x + x0, d->y + r, gray + (r - y) * w + (x0 - x), x1 - x0, nullptr);
+    }
+    return true;
+  }
+
+  if (y != d->bandTop)
+  {
+    ditherFlush(d);
+    d->bandTop = y;
+  }
+
+  uint16_t n = d->right - d->left;
+  for (uint16_t r = 0; r < h; r++)
+  {
+    memcpy(d->band + r * n + (x0 - d->left), gray + r * w + (x0 - x), x1 - x0);
+  }
+  return true;
+}
 
 
-#ifdef SMOOTH_FONT // These functions require smooth fonts to be enabled
 /***************************************************************************************
-** Function name:           setCursorRTL
-** Description:             Set the RTL cursor position
+** Function name:           drawJpegDithered
+** Description:             dither a jpeg stored in SPIFFS into an ePaper bitmap
 ***************************************************************************************/
-// Set the RTL cursor position
-void TFT_eFEX::setCursorRTL(int32_t cx, int32_t cy)
-{
-  rtl_cursorX = cx;
-  rtl_cursorY = cy;
+bool TFT_eFEX::drawJpegDithered(String filename, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method) {
+
+  // Note: ESP32 passes "open" test even if file does not exist, whereas ESP8266 returns NULL
+  if ( !SPIFFS.exists(filename) )
+  {
+    Serial.println(F(" Jpeg file not found")); // Can comment out if not needed
+    return false;
+  }
+
+  fs::File file = SPIFFS.open(filename, "r");
+  if (!file) return false;
+
+  bool decoded = jpegDither(&file, nullptr, file.size(), x, y, bitmap, method);
+
+  file.close();
+
+  return decoded;
 }
 
 
 /***************************************************************************************
-** Function name:           drawStringRTL
-** Description:             Draw the string RTL and update cursor coordinates
+** Function name:           drawJpegDithered
+** Description:             dither a jpeg stored in FLASH into an ePaper bitmap
 ***************************************************************************************/
-void TFT_eFEX::drawStringRTL(const String& string)
-{
-  int16_t len = string.length() + 2;
-  char sbuffer[len];
-  string.toCharArray(sbuffer, len);
-  drawStringRTL(sbuffer, &rtl_cursorX, &rtl_cursorY);
+bool TFT_eFEX::drawJpegDithered(const uint8_t arrayname[], uint32_t array_size, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method) {
+
+  return jpegDither(nullptr, arrayname, array_size, x, y, bitmap, method);
 }
 
 
 /***************************************************************************************
-** Function name:           drawStringRTL
-** Description:             Draw the string RTL at defined coordinates
+** Function name:           jpegDither
+** Description:             decode a jpeg to luma and dither it into an ePaper bitmap
 ***************************************************************************************/
-// Must call with variables, &x and &y
-void TFT_eFEX::drawStringRTL(const char *string, int32_t *x, int32_t *y)
-{
-  int32_t poX = *x;
-  int32_t poY = *y;
+// The decoder outputs luma only, so there is no colour conversion. Error diffusion
+// needs one row of MCUs of luma plus one row of errors, ordered dithering neither
+bool TFT_eFEX::jpegDither(fs::File *file, const uint8_t *data, uint32_t len, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method) {
 
-  int16_t len = strlen(string);
+  if ((bitmap == nullptr) || (bitmap->buf == nullptr) || (bitmap->bits < 1) || (bitmap->bits > 2)) return false;
 
-  if (_tft->fontLoaded)
+  TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+  if (jpeg == nullptr)
   {
-    uint8_t datum = _tft->getTextDatum();
-    int16_t cx = _tft->getCursorX();
-    int16_t cy = _tft->getCursorY();
-    _tft->setTextDatum(TL_DATUM);
-    uint16_t n = 0;
-    while (n < len)
-    {
-      uint16_t uniCode = _tft->decodeUTF8((uint8_t*)string, &n, len - n);
-      uint16_t gNum = 0;
-      bool found = _tft->getUnicodeIndex(uniCode, &gNum);
+    Serial.println(F("Not enough RAM for Jpeg decoder"));
+    return false;
+  }
 
-      if (uniCode == 0x20)
+  jpeg_io_t io;
+  io.file  = file;
+  io.stream = nullptr;
+  io.data  = data;
+  io.len   = len;
+  io.stats = nullptr;
+
+  fjpg_result_t result = jpeg->prepare(jpegInput, &io);
+
+  dither_io_t d;
+  d.bitmap  = bitmap;
+  d.method  = method;
+  d.x       = x;
+  d.y       = y;
+  d.band    = nullptr;
+  d.bandTop = -1;
+  d.err     = nullptr;
+
+  if (result == FJPG_OK)
+  {
+    // Only decode the part of the image that lands in the bitmap
+    d.left   = (x < 0) ? -x : 0;
+    d.top    = (y < 0) ? -y : 0;
+    d.right  = (x + jpeg->width  > bitmap->width)  ? bitmap->width  - x : jpeg->width;
+    d.bottom = (y + jpeg->height > bitmap->height) ? bitmap->height - y : jpeg->height;
+    d.bandH  = jpeg->mcuHeight;
+
+    if ((d.right > d.left) && (d.bottom > d.top))
+    {
+      if (method != DITHER_ORDERED)
       {
-        poX -= _tft->gFont.spaceWidth;
+        d.band = (uint8_t *)malloc((d.right - d.left) * d.bandH);
+        d.err  = (int16_t *)calloc(d.right - d.left + 2, sizeof(int16_t));
       }
-      else if (uniCode == '\n')
+
+      if ((method == DITHER_ORDERED) || (d.band && d.err))
       {
-        poX = _tft->width() - 1;
-        poY += _tft->gFont.yAdvance;
+        jpeg->setClip(d.left, d.top, d.right - d.left, d.bottom - d.top);
+        jpeg->luma = true;
+        result = jpeg->decode(jpegDitherOutput, &d);
+        if (result == FJPG_OK) ditherFlush(&d);
       }
-
-      if (found)
+      else
       {
-        poX -= ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
-
-        if (poX < 0)
-        {
-          poX = _tft->width() - ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
-          poY += _tft->gFont.yAdvance;
-          if (poY >= _tft->height()) poY = 0;
-        }
-
-        _tft->setCursor(poX, poY);
-        _tft->drawGlyph(uniCode);
+        Serial.println(F("Not enough RAM to dither Jpeg"));
+        result = FJPG_PARAMETER;
       }
     }
+  }
 
-    _tft->setTextDatum(datum);
-    _tft->setCursor(cx, cy);
+  free(d.band);
+  free(d.err);
+  free(jpeg);
 
-    *x = poX;
-    *y = poY;
-  }
+  if (result != FJPG_OK) Serial.println("Jpeg file format not supported!");
+
+  return (result == FJPG_OK);
 }
 
+
 /***************************************************************************************
-** Function name:           drawStringRTLAr
-** Description:             Draw the string Arabic RTL and update cursor coordinates
+** Function name:           drawBmpDithered
+** Description:             dither a 24 bit bmp stored in SPIFFS into an ePaper bitmap
 ***************************************************************************************/
-void TFT_eFEX::drawStringRTLAr(const String &string)
+// Rows are dithered as they are read (bottom up), with one line buffer and for error
+// diffusion one row of errors
+bool TFT_eFEX::drawBmpDithered(String filename, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method) {
+
+  if ((bitmap == nullptr) || (bitmap->buf == nullptr) || (bitmap->bits < 1) || (bitmap->bits > 2)) return false;
+
+  // Note: ESP32 passes "open" test even if file does not exist, whereas ESP8266 returns NULL
+  if ( !SPIFFS.exists(filename) )
+  {
+    Serial.println(F(" File not found")); // Can comment out if not needed
+    return false;
+  }
+
+  fs::File bmpFS = SPIFFS.open(filename, "r");
+  if (!bmpFS) return false;
+
+  bool ok = false;
+
+  if (read16(bmpFS) == 0x4D42)
+  {
+    read32(bmpFS);
+    read32(bmpFS);
+    uint32_t seekOffset = read32(bmpFS);
+    read32(bmpFS);
+    int32_t w = read32(bmpFS);
+    int32_t h = read32(bmpFS);
+
+    if ((read16(bmpFS) == 1) && (read16(bmpFS) == 24) && (read32(bmpFS) == 0))
+    {
+      // Visible part of the image
+      int32_t left   = (x < 0) ? -x : 0;
+      int32_t top    = (y < 0) ? -y : 0;
+      int32_t right  = (x + w > bitmap->width)  ? bitmap->width  - x : w;
+      int32_t bottom = (y + h > bitmap->height) ? bitmap->height - y : h;
+
+      ok = true;
+
+      if ((right > left) && (bottom > top))
+      {
+        uint16_t padding = (4 - ((w * 3) & 3)) & 3;
+        uint32_t rowSize = w * 3 + padding;
+        uint8_t  lineBuffer[rowSize];
+        int16_t *err = nullptr;
+
+        if (method != DITHER_ORDERED)
+        {
+          err = (int16_t *)calloc(right - left + 2, sizeof(int16_t));
+          if (err == nullptr) ok = false;
+        }
+
+        // Rows are stored bottom up, skip those below the bitmap
+        bmpFS.seek(seekOffset + (h - bottom) * rowSize);
+
+        for (int32_t row = bottom - 1; ok && (row >= top); row--)
+        {
+          bmpFS.read(lineBuffer, rowSize);
+
+          // Luma of the visible pixels, written over the start of the line
+          uint8_t *bptr = lineBuffer + left * 3;
+          for (int32_t col = 0; col < right - left; col++)
+          {
+            lineBuffer[col] = (bptr[0] * 29 + bptr[1] * 150 + bptr[2] * 77) >> 8; // B, G, R
+            bptr += 3;
+          }
+
+          ditherRow(bitmap, method, x + left, y + row, lineBuffer, right - left, err);
+        }
+
+        free(err);
+      }
+    }
+    else Serial.println("BMP format not recognised.");
+  }
+  bmpFS.close();
+
+  return ok;
+}
+
+
+/***************************************************************************************
+** Function name:           restoreBackground
+** Description:             redraw a rectangle of the TFT from the images drawJpeg() drew
+***************************************************************************************/
+// Images are redrawn oldest first so later images still cover earlier ones
+bool TFT_eFEX::restoreBackground(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+
+  // Clip to the TFT
+  int32_t x0 = (x < 0) ? 0 : x;
+  int32_t y0 = (y < 0) ? 0 : y;
+  int32_t x1 = (x + w > _tft->width())  ? _tft->width()  : x + w;
+  int32_t y1 = (y + h > _tft->height()) ? _tft->height() : y + h;
+  if ((x1 <= x0) || (y1 <= y0)) return true;
+
+  bool ok = true;
+
+  // Parts of the rectangle redrawn, and their edges plus the rectangle's own
+  int32_t part[JPG_BACKGROUNDS][4];
+  int32_t xe[2 * JPG_BACKGROUNDS + 2] = { x0, x1 };
+  int32_t ye[2 * JPG_BACKGROUNDS + 2] = { y0, y1 };
+  uint8_t parts = 0;
+
+  for (uint8_t i = 0; i < jpg_bg_count; i++)
+  {
+    jpeg_background_t *bg = &jpg_bg[i];
+
+    int32_t bx0 = (bg->x > x0) ? bg->x : x0;
+    int32_t by0 = (bg->y > y0) ? bg->y : y0;
+    int32_t bx1 = (bg->x + bg->w < x1) ? bg->x + bg->w : x1;
+    int32_t by1 = (bg->y + bg->h < y1) ? bg->y + bg->h : y1;
+    if ((bx1 <= bx0) || (by1 <= by0)) continue;
+
+    if (!backgroundDraw(bg, bx0, by0, bx1 - bx0, by1 - by0))
+    {
+      ok = false;
+      continue;
+    }
+
+    part[parts][0] = bx0; part[parts][1] = by0; part[parts][2] = bx1; part[parts][3] = by1;
+    xe[2 * parts + 2] = bx0; xe[2 * parts + 3] = bx1;
+    ye[2 * parts + 2] = by0; ye[2 * parts + 3] = by1;
+    parts++;
+  }
+  if (!ok) return false;
+
+  // The edges cut the rectangle into a grid of cells that are each either inside or
+  // outside every part, so it is all restored if every cell is inside a part. This
+  // gives the union, images that overlap are not counted twice
+  uint8_t edges = 2 * parts + 2;
+  for (uint8_t i = 1; i < edges; i++)
+  {
+    for (uint8_t j = i; (j > 0) && (xe[j - 1] > xe[j]); j--) { int32_t t = xe[j]; xe[j] = xe[j - 1]; xe[j - 1] = t; }
+    for (uint8_t j = i; (j > 0) && (ye[j - 1] > ye[j]); j--) { int32_t t = ye[j]; ye[j] = ye[j - 1]; ye[j - 1] = t; }
+  }
+
+  for (uint8_t i = 0; i + 1 < edges; i++)
+  {
+    if (xe[i] == xe[i + 1]) continue;
+    for (uint8_t j = 0; j + 1 < edges; j++)
+    {
+      if (ye[j] == ye[j + 1]) continue;
+      uint8_t p = 0;
+      while ((p < parts) && ((xe[i] < part[p][0]) || (xe[i + 1] > part[p][2]) ||
+                             (ye[j] < part[p][1]) || (ye[j + 1] > part[p][3]))) p++;
+      if (p == parts) return false; // Nothing was drawn in this cell
+    }
+  }
+
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           clearBackground
+** Description:             forget the images remembered for restoreBackground()
+***************************************************************************************/
+void TFT_eFEX::clearBackground(void) {
+  for (uint8_t i = 0; i < jpg_bg_count; i++) free(jpg_bg[i].path);
+  jpg_bg_count = 0;
+}
+
+
+/***************************************************************************************
+** Function name:           backgroundAdd
+** Description:             remember an image drawn on the TFT by drawJpeg()
+***************************************************************************************/
+// Older images hidden by the new one are forgotten, and the oldest is dropped if
+// JPG_BACKGROUNDS are already remembered. The size comes from the last decode
+void TFT_eFEX::backgroundAdd(const char *path, const uint8_t *data, uint32_t size, int16_t x, int16_t y) {
+
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < jpg_bg_count; i++)
+  {
+    jpeg_background_t *bg = &jpg_bg[i];
+    bool hidden = (bg->x >= x) && (bg->y >= y) &&
+                  (bg->x + bg->w <= x + jpeg_width) && (bg->y + bg->h <= y + jpeg_height);
+    if (hidden || ((i == 0) && (jpg_bg_count == JPG_BACKGROUNDS)))
+    {
+      free(bg->path);
+      continue;
+    }
+    jpg_bg[n++] = *bg;
+  }
+
+  jpeg_background_t *bg = &jpg_bg[n];
+  bg->path = path ? strdup(path) : nullptr;
+  if (path && (bg->path == nullptr))
+  {
+    jpg_bg_count = n;
+    return;
+  }
+  bg->data = data;
+  bg->size = size;
+  bg->x    = x;
+  bg->y    = y;
+  bg->w    = jpeg_width;
+  bg->h    = jpeg_height;
+  jpg_bg_count = n + 1;
+}
+
+
+/***************************************************************************************
+** Function name:           backgroundDraw
+** Description:             redraw the part of a remembered image inside a rectangle
+***************************************************************************************/
+// x, y, w, h is on the TFT and inside the image
+bool TFT_eFEX::backgroundDraw(jpeg_background_t *bg, int16_t x, int16_t y, uint16_t w, uint16_t h) {
+
+  fs::File file;
+  uint32_t mtime = 0;
+  if (bg->path)
+  {
+    file = SPIFFS.open(bg->path, "r");
+    if (!file) return false;
+    mtime = file.getLastWrite();
+  }
+
+  // From the cache, only the rectangle is pushed
+  image_cache_entry_t *entry = nullptr;
+  if (img_cache_stats.budget) entry = cacheFind(bg->path, bg->data, bg->size, mtime, false);
+  if (entry)
+  {
+    uint16_t *data = entry->pixels + (y - bg->y) * entry->width + (x - bg->x);
+    _tft->startWrite();
+    _tft->setAddrWindow(x, y, w, h);
+    for (uint16_t row = 0; row < h; row++)
+    {
+      _tft->pushColors(data, w, false);
+      data += entry->width;
+    }
+    _tft->endWrite();
+    if (bg->path) file.close();
+    return true;
+  }
+
+  // Decode the MCUs that overlap the rectangle, the decoder stops below it
+  bool ok = jpegRender(bg->path ? &file : nullptr, bg->data, bg->path ? file.size() : bg->size, x, y, nullptr, nullptr,
+                       0, w, h, false, x - bg->x, y - bg->y);
+
+  if (bg->path) file.close();
+  return ok;
+}
+
+
+/***************************************************************************************
+** Function name:           jpegInfo
+** Description:             Print information decoded from the Jpeg image
+***************************************************************************************/
+void TFT_eFEX::jpegInfo(String filename) {
+  // Note: ESP32 passes "open" test even if file does not exist, whereas ESP8266 returns NULL
+  if ( !SPIFFS.exists(filename) )
+  {
+    Serial.println(F(" Jpeg file not found")); // Can comment out if not needed
+    return;
+  }
+
+  fs::File jpegFile = SPIFFS.open( filename, "r");    // File handle reference for SPIFFS
+  //  File jpegFile = SD.open( filename, FILE_READ);  // or, file handle reference for SD library
+  if (!jpegFile) return;
+
+  jpegHeader(&jpegFile, nullptr, jpegFile.size());
+
+  jpegFile.close();
+}
+
+
+/***************************************************************************************
+** Function name:           jpegInfo
+** Description:             Print information decoded from the Jpeg image
+***************************************************************************************/
+void TFT_eFEX::jpegInfo(const uint8_t arrayname[], uint32_t array_size) {
+
+  jpegHeader(nullptr, arrayname, array_size);
+}
+
+
+/***************************************************************************************
+** Function name:           jpegHeader
+** Description:             Read the jpeg headers and print the image information
+***************************************************************************************/
+void TFT_eFEX::jpegHeader(fs::File *file, const uint8_t *data, uint32_t len) {
+
+  TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+  if (jpeg == nullptr) return;
+
+  jpeg_io_t io;
+  io.file = file;
+  io.stream = nullptr;
+  io.data = data;
+  io.len  = len;
+  io.stats = nullptr;
+
+  static const char line[] PROGMEM =  "===============";
+
+  fjpg_result_t result = jpeg->prepare(jpegInput, &io);
+
+  if (result == FJPG_OK) {
+    Serial.println(FPSTR(line));
+    Serial.println(F("JPEG image info"));
+    Serial.println(FPSTR(line));
+    Serial.print  (F("Width      :")); Serial.println(jpeg->width);
+    Serial.print  (F("Height     :")); Serial.println(jpeg->height);
+    Serial.print  (F("Components :")); Serial.println(jpeg->comps);
+    Serial.print  (F("MCU / row  :")); Serial.println(jpeg->mcusPerRow);
+    Serial.print  (F("MCU / col  :")); Serial.println(jpeg->mcusPerCol);
+    Serial.print  (F("Restarts   :")); Serial.println(jpeg->restartInterval);
+    Serial.print  (F("MCU width  :")); Serial.println(jpeg->mcuWidth);
+    Serial.print  (F("MCU height :")); Serial.println(jpeg->mcuHeight);
+    Serial.println(FPSTR(line));
+    Serial.println("");
+  }
+  else if (result == FJPG_UNSUPPORTED)
+  {
+    Serial.println(F("Jpeg is progressive or not supported"));
+  }
+
+  free(jpeg);
+}
+
+
+/***************************************************************************************
+** Function name:           drawProgressBar
+** Description:             Draw a progress bar - increasing percentage only
+***************************************************************************************/
+void TFT_eFEX::drawProgressBar(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t percent, uint16_t frameColor, uint16_t barColor) {
+  if (percent == 0) {
+    _tft->fillRoundRect(x, y, w, h, 3, TFT_BLACK);
+  }
+  uint8_t margin = 2;
+  uint16_t barHeight = h - 2 * margin;
+  uint16_t barWidth  = w - 2 * margin;
+  _tft->drawRoundRect(x, y, w, h, 3, frameColor);
+  _tft->fillRect(x + margin, y + margin, barWidth * percent / 100.0, barHeight, barColor);
+}
+
+
+/***************************************************************************************
+** Function name:           luminance
+** Description:             return a 16 bit colour with reduced luminance
+***************************************************************************************/
+uint16_t TFT_eFEX::luminance(uint16_t color, uint8_t luminance)
 {
-  int16_t len = string.length() + 2;
-  // Serial.print("Size:");
-  // Serial.println((String)len);
-  char sbuffer[len];
-  string.toCharArray(sbuffer, len);
-  drawStringRTLAr(sbuffer, &rtl_cursorX, &rtl_cursorY);
+  // Extract rgb colours and stretch range to 0 - 255
+  uint16_t r = (color & 0xF800) >> 8; r |= (r >> 5);
+  uint16_t g = (color & 0x07E0) >> 3; g |= (g >> 6);
+  uint16_t b = (color & 0x001F) << 3; b |= (b >> 5);
+
+  b = ((b * (uint16_t)luminance + 255) >> 8) & 0x00F8;
+  g = ((g * (uint16_t)luminance + 255) >> 8) & 0x00FC;
+  r = ((r * (uint16_t)luminance + 255) >> 8) & 0x00F8;
+
+  return (r << 8) | (g << 3) | (b >> 3);
 }
+
+
 /***************************************************************************************
-** Function name:           isFrom
-** Description:             If the font has a From 
+** Function name:           luminance
+** Description:             return a 16 bit colour from an RGB with reduced luminance
 ***************************************************************************************/
-#define ISOLATED 1
-#define INITIAL 2
-#define MEDIAL 3
-#define FINAL 4
+uint16_t TFT_eFEX::luminance(uint8_t red, uint8_t green, uint8_t blue, uint8_t luminance)
+{
+  uint16_t b = (((uint16_t)blue  * (uint16_t)luminance + 255) >> 8) & 0x00F8;
+  uint16_t g = (((uint16_t)green * (uint16_t)luminance + 255) >> 8) & 0x00FC;
+  uint16_t r = (((uint16_t)red   * (uint16_t)luminance + 255) >> 8) & 0x00F8;
 
-const uint8_t CODECOUNT = 180;
-const uint16_t codes[CODECOUNT][5] PROGMEM = {
-  //'<isolated>', '<initial>', '<medial>', '<final>'
-//#ARABIC LETTER HAMZA
-  0x0621,0xFE80, 0, 0, 0,
-//#ARABIC LETTER ALEF WITH MADDA ABOVE
-  0x0622,0x0622, 0, 0, 0xFE82,
-//#ARABIC LETTER ALEF WITH HAMZA ABOVE
-  0x0623,0x0623, 0, 0, 0xFE84,
-//#ARABIC LETTER WAW WITH HAMZA ABOVE
-  0x0624,0x0624, 0, 0, 0xFE86,
-//#ARABIC LETTER ALEF WITH HAMZA BELOW
-  0x0625,0x0625, 0, 0, 0xFE88,
-//#ARABIC LETTER YEH WITH HAMZA ABOVE
-  0x0626,0x0626, 0xFE8B, 0xFE8C, 0xFE8A,
-//#ARABIC LETTER ALEF
-  0x0627,0x0627, 0, 0, 0xFE8E,
-//#ARABIC LETTER BEH
-  0x0628,0x0628, 0xFE91, 0xFE92, 0xFE90,
-//#ARABIC LETTER TEH MARBUTA
-  0x0629,0x0629, 0, 0, 0xFE94,
-//#ARABIC LETTER TEH
-  0x062A,0x062A, 0xFE97, 0xFE98, 0xFE96,
-//#ARABIC LETTER THEH
-  0x062B,0x062B, 0xFE9B, 0xFE9C, 0xFE9A,
-//#ARABIC LETTER JEEM
-  0x062C,0x062C, 0xFE9F, 0xFEA0, 0xFE9E,
-//#ARABIC LETTER HAH
-  0x062D,0xFEA1, 0xFEA3, 0xFEA4, 0xFEA2,
-//#ARABIC LETTER KHAH
-  0x062E,0x062E, 0xFEA7, 0xFEA8, 0xFEA6,
-//#ARABIC LETTER DAL
-  0x062F,0x062F, 0, 0, 0xFEAA,
-//#ARABIC LETTER THAL
-  0x0630,0x0630, 0, 0, 0xFEAC,
-//#ARABIC LETTER REH
-  0x0631,0x0631, 0, 0, 0xFEAE,
-//#ARABIC LETTER ZAIN
-  0x0632,0x0632, 0, 0, 0xFEB0,
-//#ARABIC LETTER SEEN
-  0x0633,0x0633, 0xFEB3, 0xFEB4, 0xFEB2,
-//#ARABIC LETTER SHEEN
-  0x0634,0x0634, 0xFEB7, 0xFEB8, 0xFEB6,
-//#ARABIC LETTER SAD
-  0x0635,0x0635, 0xFEBB, 0xFEBC, 0xFEBA,
-//#ARABIC LETTER DAD
-  0x0636,0x0636, 0xFEBF, 0xFEC0, 0xFEBE,
+  return (r << 8) | (g << 3) | (b >> 3);
+}
+
+
+/***************************************************************************************
+** Function name:           rainbowColor
+** Description:             Return a 16 bit rainbow colour
+***************************************************************************************/
+
+  // If 'spectrum' is in the range 0-159 it is converted to a spectrum colour
+  // from 0 = red through to 127 = blue to 159 = violet
+  // Extending the range to 0-191 adds a further violet to red band
+ 
+uint16_t TFT_eFEX::rainbowColor(uint8_t spectrum)
+{
+  spectrum = spectrum%192;
+  
+  uint8_t red   = 0; // Red is the top 5 bits of a 16 bit colour spectrum
+  uint8_t green = 0; // Green is the middle 6 bits, but only top 5 bits used here
+  uint8_t blue  = 0; // Blue is the bottom 5 bits
+
+  uint8_t sector = spectrum >> 5;
+  uint8_t amplit = spectrum & 0x1F;
+
+  switch (sector)
+  {
+    case 0:
+      red   = 0x1F;
+      green = amplit; // Green ramps up
+      blue  = 0;
+      break;
+    case 1:
+      red   = 0x1F - amplit; // Red ramps down
+      green = 0x1F;
+      blue  = 0;
+      break;
+    case 2:
+      red   = 0;
+      green = 0x1F;
+      blue  = amplit; // Blue ramps up
+      break;
+    case 3:
+      red   = 0;
+      green = 0x1F - amplit; // Green ramps down
+      blue  = 0x1F;
+      break;
+    case 4:
+      red   = amplit; // Red ramps up
+      green = 0;
+      blue  = 0x1F;
+      break;
+    case 5:
+      red   = 0x1F;
+      green = 0;
+      blue  = 0x1F - amplit; // Blue ramps down
+      break;
+  }
+
+  return red << 11 | green << 6 | blue;
+}
+
+
+/***************************************************************************************
+** Function name:           listSPIFFS
+** Description:             Listing SPIFFS files
+***************************************************************************************/
+#ifdef ESP8266
+void TFT_eFEX::listSPIFFS(void) {
+  Serial.println(F("\r\nListing SPIFFS files:"));
+
+  fs::Dir dir = SPIFFS.openDir("/"); // Root directory
+
+  static const char line[] PROGMEM =  "=================================================";
+  Serial.println(FPSTR(line));
+  Serial.println(F("  File name                              Size"));
+  Serial.println(FPSTR(line));
+
+  while (dir.next()) {
+    String fileName = dir.fileName();
+    Serial.print(fileName);
+    int spaces = 33 - fileName.length(); // Tabulate nicely
+    if (spaces < 1) spaces = 1;
+    while (spaces--) Serial.print(" ");
+
+    fs::File f = dir.openFile("r");
+    String fileSize = (String) f.size();
+    spaces = 10 - fileSize.length(); // Tabulate nicely
+    if (spaces < 1) spaces = 1;
+    while (spaces--) Serial.print(" ");
+    Serial.println(fileSize + " bytes");
+  }
+
+  Serial.println(FPSTR(line));
+  Serial.println();
+  delay(1000);
+}
+
+//====================================================================================
+
+#elif defined ESP32
+// TODO: add sub directories
+void TFT_eFEX::listSPIFFS(void) {
+  Serial.println(F("\r\nListing SPIFFS files:"));
+  static const char line[] PROGMEM =  "=================================================";
+
+  Serial.println(FPSTR(line));
+  Serial.println(F("  File name                              Size"));
+  Serial.println(FPSTR(line));
+
+  fs::File root = SPIFFS.open("/");
+  if (!root) {
+    Serial.println(F("Failed to open directory"));
+    return;
+  }
+  if (!root.isDirectory()) {
+    Serial.println(F("Not a directory"));
+    return;
+  }
+
+  fs::File file = root.openNextFile();
+  while (file) {
+
+    if (file.isDirectory()) {
+      Serial.print("DIR : ");
+      String fileName = file.name();
+      Serial.print(fileName);
+    } else {
+      String fileName = file.name();
+      Serial.print("  " + fileName);
+      // File path can be 31 characters maximum in SPIFFS
+      int spaces = 33 - fileName.length(); // Tabulate nicely
+      if (spaces < 1) spaces = 1;
+      while (spaces--) Serial.print(" ");
+      String fileSize = (String) file.size();
+      spaces = 10 - fileSize.length(); // Tabulate nicely
+      if (spaces < 1) spaces = 1;
+      while (spaces--) Serial.print(" ");
+      Serial.println(fileSize + " bytes");
+    }
+
+    file = root.openNextFile();
+  }
+
+  Serial.println(FPSTR(line));
+  Serial.println();
+  delay(1000);
+}
+
+#else
+
+void TFT_eFEX::listSPIFFS(void) {}
+
+#endif
+
+
+#ifdef SMOOTH_FONT // These functions require smooth fonts to be enabled
+/***************************************************************************************
+** Function name:           setCursorRTL
+** Description:             Set the RTL cursor position
+***************************************************************************************/
+// Set the RTL cursor position
+void TFT_eFEX::setCursorRTL(int32_t cx, int32_t cy)
+{
+  rtl_cursorX = cx;
+  rtl_cursorY = cy;
+}
+
+
+/***************************************************************************************
+** Function name:           drawStringRTL
+** Description:             Draw the string RTL and update cursor coordinates
+***************************************************************************************/
+void TFT_eFEX::drawStringRTL(const String& string)
+{
+  int16_t len = string.length() + 2;
+  char sbuffer[len];
+  string.toCharArray(sbuffer, len);
+  drawStringRTL(sbuffer, &rtl_cursorX, &rtl_cursorY);
+}
+
+
+/***************************************************************************************
+** Function name:           drawStringRTL
+** Description:             Draw the string RTL at defined coordinates
+***************************************************************************************/
+// Must call with variables, &x and &y
+void TFT_eFEX::drawStringRTL(const char *string, int32_t *x, int32_t *y)
+{
+  int32_t poX = *x;
+  int32_t poY = *y;
+
+  int16_t len = strlen(string);
+
+  if (_tft->fontLoaded)
+  {
+    uint8_t datum = _tft->getTextDatum();
+    int16_t cx = _tft->getCursorX();
+    int16_t cy = _tft->getCursorY();
+    _tft->setTextDatum(TL_DATUM);
+    uint16_t n = 0;
+    while (n < len)
+    {
+      uint16_t uniCode = _tft->decodeUTF8((uint8_t*)string, &n, len - n);
+      uint16_t gNum = 0;
+      bool found = _tft->getUnicodeIndex(uniCode, &gNum);
+
+      if (uniCode == 0x20)
+      {
+        poX -= _tft->gFont.spaceWidth;
+      }
+      else if (uniCode == '\n')
+      {
+        poX = _tft->width() - 1;
+        poY += _tft->gFont.yAdvance;
+      }
+
+      if (found)
+      {
+        poX -= ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
+
+        if (poX < 0)
+        {
+          poX = _tft->width() - ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
+          poY += _tft->gFont.yAdvance;
+          if (poY >= _tft->height()) poY = 0;
+        }
+
+        _tft->setCursor(poX, poY);
+        _tft->drawGlyph(uniCode);
+      }
+    }
+
+    _tft->setTextDatum(datum);
+    _tft->setCursor(cx, cy);
+
+    *x = poX;
+    *y = poY;
+  }
+}
+
+/***************************************************************************************
+** Function name:           drawStringRTLAr
+** Description:             Draw the string Arabic RTL and update cursor coordinates
+***************************************************************************************/
+void TFT_eFEX::drawStringRTLAr(const String &string)
+{
+  int16_t len = string.length() + 2;
+  // Serial.print("Size:");
+  // Serial.println((String)len);
+  char sbuffer[len];
+  string.toCharArray(sbuffer, len);
+  drawStringRTLAr(sbuffer, &rtl_cursorX, &rtl_cursorY);
+}
+/***************************************************************************************
+** Function name:           isFrom
+** Description:             If the font has a From 
+***************************************************************************************/
+#define ISOLATED 1
+#define INITIAL 2
+#define MEDIAL 3
+#define FINAL 4
+
+const uint8_t CODECOUNT = 180;
+const uint16_t codes[CODECOUNT][5] PROGMEM = {
+  //'<isolated>', '<initial>', '<medial>', '<final>'
+//#ARABIC LETTER HAMZA
+  0x0621,0xFE80, 0, 0, 0,
+//#ARABIC LETTER ALEF WITH MADDA ABOVE
+  0x0622,0x0622, 0, 0, 0xFE82,
+//#ARABIC LETTER ALEF WITH HAMZA ABOVE
+  0x0623,0x0623, 0, 0, 0xFE84,
+//#ARABIC LETTER WAW WITH HAMZA ABOVE
+  0x0624,0x0624, 0, 0, 0xFE86,
+//#ARABIC LETTER ALEF WITH HAMZA BELOW
+  0x0625,0x0625, 0, 0, 0xFE88,
+//#ARABIC LETTER YEH WITH HAMZA ABOVE
+  0x0626,0x0626, 0xFE8B, 0xFE8C, 0xFE8A,
+//#ARABIC LETTER ALEF
+  0x0627,0x0627, 0, 0, 0xFE8E,
+//#ARABIC LETTER BEH
+  0x0628,0x0628, 0xFE91, 0xFE92, 0xFE90,
+//#ARABIC LETTER TEH MARBUTA
+  0x0629,0x0629, 0, 0, 0xFE94,
+//#ARABIC LETTER TEH
+  0x062A,0x062A, 0xFE97, 0xFE98, 0xFE96,
+//#ARABIC LETTER THEH
+  0x062B,0x062B, 0xFE9B, 0xFE9C, 0xFE9A,
+//#ARABIC LETTER JEEM
+  0x062C,0x062C, 0xFE9F, 0xFEA0, 0xFE9E,
+//#ARABIC LETTER HAH
+  0x062D,0xFEA1, 0xFEA3, 0xFEA4, 0xFEA2,
+//#ARABIC LETTER KHAH
+  0x062E,0x062E, 0xFEA7, 0xFEA8, 0xFEA6,
+//#ARABIC LETTER DAL
+  0x062F,0x062F, 0, 0, 0xFEAA,
+//#ARABIC LETTER THAL
+  0x0630,0x0630, 0, 0, 0xFEAC,
+//#ARABIC LETTER REH
+  0x0631,0x0631, 0, 0, 0xFEAE,
+//#ARABIC LETTER ZAIN
+  0x0632,0x0632, 0, 0, 0xFEB0,
+//#ARABIC LETTER SEEN
+  0x0633,0x0633, 0xFEB3, 0xFEB4, 0xFEB2,
+//#ARABIC LETTER SHEEN
+  0x0634,0x0634, 0xFEB7, 0xFEB8, 0xFEB6,
+//#ARABIC LETTER SAD
+  0x0635,0x0635, 0xFEBB, 0xFEBC, 0xFEBA,
+//#ARABIC LETTER DAD
+  0x0636,0x0636, 0xFEBF, 0xFEC0, 0xFEBE,
 //#ARABIC LETTER TAH
   0x0637,0x0637, 0xFEC3, 0xFEC4, 0xFEC2,
 //#ARABIC LETTER ZAH
@@ -999,677 +2078,2449 @@ const uint16_t codes[CODECOUNT][5] PROGMEM = {
   0x06d5,0x06d5, 0, 0, 0xE000,
 };
 
-bool isFrom(uint16_t ch, int loc = INITIAL)
-{
-  if(!(ch >= 0x0621 && ch <= 0x06d5)){
-    return false;
-  }
-  uint16_t st = 0;
-  if((ch - 0x0621)>0){
-    st =0;
-  }
-  for (uint16_t i = st; i < CODECOUNT; i++) //Optimize finidng speed
-  {
-    if (codes[i][0] == ch)
-    {
-      if (codes[i][loc]>0)
-        return true;
-      else
-        return false;
+bool isFrom(uint16_t ch, int loc = INITIAL)
+{
+  if(!(ch >= 0x0621 && ch <= 0x06d5)){
+    return false;
+  }
+  uint16_t st = 0;
+  if((ch - 0x0621)>0){
+    st =0;
+  }
+  for (uint16_t i = st; i < CODECOUNT; i++) //Optimize finidng speed
+  {
+    if (codes[i][0] == ch)
+    {
+      if (codes[i][loc]>0)
+        return true;
+      else
+        return false;
+    }
+  }
+  return false;
+}
+/***************************************************************************************
+** Function name:           Location
+** Description:             Find the location of the current letter
+***************************************************************************************/
+uint8_t Location(uint16_t ch, uint16_t NextChar, uint16_t PrevChar)
+{
+  /*
+  ('<isolated>', '<initial>', '<medial>', '<final>')
+    */
+  uint8_t stat;
+  bool p = isFrom(PrevChar, INITIAL);
+  bool n = isFrom(NextChar, FINAL);
+  // Serial.print("$");
+  // Serial.print(NextChar);
+  // Serial.print("$");
+  // Serial.print(PrevChar);
+  // Serial.print("$");
+  // Serial.print(PrevChar -  0x0620);
+  // Serial.print("P");
+  // Serial.println((String) p + (String) n );
+
+  if (p) // initail
+  {
+    if (n) // end
+      stat = MEDIAL; 
+    else
+      stat = FINAL;
+  }
+  else if (n)
+    stat = INITIAL; //Final
+  else
+    stat = ISOLATED; //Medial
+  
+
+  return stat;
+}
+/***************************************************************************************
+** Function name:           drawStringRTLAr
+** Description:             Draw the string Arabic RTL at defined coordinates
+***************************************************************************************/
+// Must call with variables, &x and &y
+void TFT_eFEX::drawStringRTLAr(const char *string, int32_t *x, int32_t *y)
+{
+  int32_t poX = *x;
+  int32_t poY = *y;
+
+  int16_t len = strlen(string);
+
+  if (_tft->fontLoaded)
+  {
+    uint8_t datum = _tft->getTextDatum();
+    int16_t cx = _tft->getCursorX();
+    int16_t cy = _tft->getCursorY();
+    _tft->setTextDatum(TL_DATUM);
+    uint16_t n = 0;
+    uint16_t PrevChar = '\0';
+    uint16_t NextChar = '\0';
+    while (n < len)
+    {
+      uint16_t uniCode = _tft->decodeUTF8((uint8_t*)string, &n, len - n);
+      uint16_t nPefore = n;
+      if (n < len)
+      {
+        NextChar = _tft->decodeUTF8((uint8_t *)string, &nPefore, len - nPefore);
+      }else{
+        NextChar = '\0';
+      }
+      if (uniCode >= 0x0621 && uniCode <= 0x06d5) //Replace Char
+      {
+        uint8_t loc = Location(uniCode,NextChar, PrevChar);
+        PrevChar = uniCode;
+        // Serial.print("X");
+        // Serial.print(uniCode, HEX);
+        // Serial.print("L");
+        // Serial.print((int)loc, HEX);
+        // Serial.print("G");
+        // Serial.print(uniCode - 0x0622, HEX);
+        for(int i=0;i<CODECOUNT;i++){
+          if (codes[i][0] == uniCode)
+          {
+            if (codes[i][loc])
+            uniCode =codes[i][loc];
+          }
+        }
+        //search for letter here
+        // Serial.print("N");
+        // Serial.println(uniCode, HEX);
+        // delay(5);
+        // yield();
+      }else{
+        PrevChar = uniCode;
+      }
+      uint16_t gNum = 0;
+      bool found = _tft->getUnicodeIndex(uniCode, &gNum);
+
+      if (uniCode == 0x20)
+      {
+        poX -= _tft->gFont.spaceWidth;
+      }
+      else if (uniCode == '\n')
+      {
+        poX = _tft->width() - 1;
+        poY += _tft->gFont.yAdvance;
+      }else if (found){
+        poX -= (_tft->gWidth[gNum] + _tft->gdX[gNum]);
+
+        if (poX < 0)
+        {
+          poX = _tft->width() - (_tft->gWidth[gNum] + _tft->gdX[gNum]);
+          poY += _tft->gFont.yAdvance;
+          if (poY >= _tft->height())
+            poY = 0;
+        }
+
+        _tft->setCursor(poX, poY);
+        _tft->drawGlyph(uniCode);
+      }
+    }
+
+    _tft->setTextDatum(datum);
+    _tft->setCursor(cx, cy);
+
+    *x = poX;
+    *y = poY;
+  }
+}
+
+/***************************************************************************************
+** Function name:           setCursorLTR
+** Description:             Draw the string LTR and update cursor coordinates
+***************************************************************************************/
+void TFT_eFEX::drawStringLTR(const String& string)
+{
+  int16_t len = string.length() + 2;
+  char sbuffer[len];
+  string.toCharArray(sbuffer, len);
+  drawStringLTR(sbuffer, &rtl_cursorX, &rtl_cursorY);
+}
+
+
+/***************************************************************************************
+** Function name:           drawStringLTR
+** Description:             Draw the string LTR at defined coordinates
+***************************************************************************************/
+void TFT_eFEX::drawStringLTR(const char *string, int32_t *x, int32_t *y)
+{
+  int32_t poX = *x;
+  int32_t poY = *y;
+
+  int16_t len = strlen(string);
+
+  uint16_t pointCodes[len];
+  uint16_t index = 0;
+
+  if (_tft->fontLoaded)
+  {
+    uint8_t datum = _tft->getTextDatum();
+    int16_t cx = _tft->getCursorX();
+    int16_t cy = _tft->getCursorY();
+    _tft->setTextDatum(TL_DATUM);
+    uint16_t n = 0;
+
+    while (n < len)
+    {
+      uint16_t uniCode = _tft->decodeUTF8((uint8_t*)string, &n, len - n);
+      pointCodes[index++] = uniCode;
+    }
+
+    while (index--)
+    {
+      uint16_t gNum = 0;
+      bool found = _tft->getUnicodeIndex(pointCodes[index], &gNum);
+
+      if (pointCodes[index] == 0x20)
+      {
+        poX -= _tft->gFont.spaceWidth;
+      }
+      else if (pointCodes[index] == '\n')
+      {
+        poX = _tft->width() - 1;
+        poY += _tft->gFont.yAdvance;
+      }
+
+      if (found)
+      {
+        poX -= ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
+
+        if (poX < 0)
+        {
+          poX = _tft->width() - ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
+          poY += _tft->gFont.yAdvance;
+          if (poY >= _tft->height()) poY = 0;
+        }
+
+        _tft->setCursor(poX, poY);
+        _tft->drawGlyph(pointCodes[index]);
+      }
+    }
+
+    _tft->setTextDatum(datum);
+    _tft->setCursor(cx, cy);
+
+    *x = poX;
+    *y = poY;
+  }
+}
+#endif // smooth font enabled
+
+//====================================================================================
+//                           Screen server call with no filename
+//====================================================================================
+// Start a screen dump server (serial or network) - no filename specified
+bool TFT_eFEX::screenServer(void)
+{
+  // With no filename the screenshot will be saved with a default name e.g. tft_screen_#.xxx
+  // where # is a number 0-9 and xxx is a file type specified below
+  return screenServer(DEFAULT_FILENAME);
+}
+
+//====================================================================================
+//                           Screen server call with filename
+//====================================================================================
+// Start a screen dump server (serial or network) - filename specified
+bool TFT_eFEX::screenServer(String filename)
+{
+  delay(0); // Equivalent to yield() for ESP8266;
+
+  boolean result = serialScreenServer(filename); // Screenshot serial port server
+  //boolean result = wifiScreenServer(filename);   // Screenshot WiFi UDP port server (WIP)
+
+  delay(0); // Equivalent to yield()
+
+  //Serial.println();
+  //if (result) Serial.println(F("Screen dump passed :-)"));
+  //else        Serial.println(F("Screen dump failed :-("));
+
+  return result;
+}
+
+//====================================================================================
+//                       Screen server call sending a Sprite
+//====================================================================================
+// The pixels come straight from the Sprite memory, nothing is read from the TFT, so it
+// works for TFTs with no MISO line and for sketches that draw everything in a Sprite
+bool TFT_eFEX::screenServer(TFT_eSprite &src, String filename)
+{
+  delay(0); // Equivalent to yield() for ESP8266;
+
+  boolean result = serialScreenServer(filename, &src);
+
+  delay(0); // Equivalent to yield()
+
+  return result;
+}
+
+//====================================================================================
+//                Serial server function that sends the data to the client
+//====================================================================================
+// Sends the TFT screen, or the Sprite if spr is not nullptr
+bool TFT_eFEX::serialScreenServer(String filename, TFT_eSprite *spr)
+{
+  // Precautionary receive buffer garbage flush for 50ms
+  uint32_t clearTime = millis() + 50;
+  while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
+
+  boolean wait = true;
+  uint32_t lastCmdTime = millis();     // Initialise start of command time-out
+
+  // Wait for the starting flag with a start time-out
+  while (wait)
+  {
+    delay(0); // Equivalent to yield() for ESP8266;
+    // Check serial buffer
+    if (Serial.available() > 0) {
+      // Read the command byte
+      uint8_t cmd = Serial.read();
+      // 'V' starts protocol 2, whole lines are sent as the client grants them
+      // It is followed by the compression methods the client can decode (1 << SCREEN_RLE etc.)
+      if ( cmd == 'V' ) {
+        lastCmdTime = millis();
+        while ( Serial.available() == 0 && millis() <= lastCmdTime + PIXEL_TIMEOUT) delay(0);
+        int methods = Serial.read();
+        if (methods < 0) return false;
+
+        uint8_t compression = SCREEN_RAW;
+        for (uint8_t c = SCREEN_RLE; c <= SCREEN_COMPRESSION; c++) if (methods & (1 << c)) compression = c;
+
+        sendParameters(filename, 2, compression, spr);
+        return serialScreenStream(compression, spr);
+      }
+
+      // If it is 'S' (start command) then clear the serial buffer for 100ms and stop waiting
+      if ( cmd == 'S' ) {
+        // Precautionary receive buffer garbage flush for 50ms
+        clearTime = millis() + 50;
+        while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
+
+        wait = false;           // No need to wait anymore
+        lastCmdTime = millis(); // Set last received command time
+
+        // Send screen size etc using a simple header with delimiters for client checks
+        sendParameters(filename, 1, SCREEN_RAW, spr);
+      }
+    }
+    else
+    {
+      // Check for time-out
+      if ( millis() > lastCmdTime + START_TIMEOUT) return false;
+    }
+  }
+
+  uint8_t color[3 * NPIXELS]; // RGB and 565 format color buffer for N pixels
+
+  uint32_t width  = spr ? spr->width()  : _tft->width();
+  uint32_t height = spr ? spr->height() : _tft->height();
+
+  // Send all the pixels on the whole screen
+  for ( uint32_t y = 0; y < height; y++)
+  {
+    // Increment x by NPIXELS as we send NPIXELS for every byte received
+    for ( uint32_t x = 0; x < width; x += NPIXELS)
+    {
+      delay(0); // Equivalent to yield() for ESP8266;
+
+      // Wait here for serial data to arrive or a time-out elapses
+      while ( Serial.available() == 0 )
+      {
+        if ( millis() > lastCmdTime + PIXEL_TIMEOUT) return false;
+        delay(0); // Equivalent to yield() for ESP8266;
+      }
+
+      // Serial data must be available to get here, read 1 byte and
+      // respond with N pixels, i.e. N x 3 RGB bytes or N x 2 565 format bytes
+      if ( Serial.read() == 'X' ) {
+        // X command byte means abort, so clear the buffer and return
+        clearTime = millis() + 50;
+        while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
+        return false;
+      }
+      // Save arrival time of the read command (for later time-out check)
+      lastCmdTime = millis();
+
+      if (spr)
+      {
+        // Same pixel format as the header says, 24 bits only if NPIXELS > 1
+        uint8_t bytes = (NPIXELS > 1 && BITS_PER_PIXEL >= 24) ? 3 : 2;
+        screenLine(spr, x, y, NPIXELS, color, bytes);
+        Serial.write(color, bytes * NPIXELS);
+        continue;
+      }
+
+#if defined BITS_PER_PIXEL && BITS_PER_PIXEL >= 24 && NPIXELS > 1
+      // Fetch N RGB pixels from x,y and put in buffer
+      _tft->readRectRGB(x, y, NPIXELS, 1, color);
+      // Send buffer to client
+      Serial.write(color, 3 * NPIXELS); // Write all pixels in the buffer
+#else
+      // Fetch N 565 format pixels from x,y and put in buffer
+      if (NPIXELS > 1) _tft->readRect(x, y, NPIXELS, 1, (uint16_t *)color);
+      else
+      {
+        uint16_t c = _tft->readPixel(x, y);
+        color[0] = c>>8;
+        color[1] = c & 0xFF;  // Swap bytes
+      }
+      // Send buffer to client
+      Serial.write(color, 2 * NPIXELS); // Write all pixels in the buffer
+#endif
+    }
+  }
+
+  Serial.flush(); // Make sure all pixel bytes have been despatched
+
+  return true;
+}
+
+//====================================================================================
+//               Screen capture line compression for protocol 2
+//====================================================================================
+// Lines are compressed in pixel units (2 or 3 bytes). A line is sent as its compressed
+// length (2 bytes, MSB first) then a series of codes, each starting with a byte c:
+//   c < 0x80         : c + 1 literal pixels follow
+// RLE (SCREEN_RLE)
+//   c >= 0x80        : the next pixel repeated (c & 0x7F) + 1 times
+// LZ (SCREEN_LZ), over the line above (all zero for the first line) and this line
+//   0x80 <= c < 0xC0 : (c & 0x3F) + 1 pixels copied from the line above
+//   c >= 0xC0        : (c & 0x3F) + 1 pixels copied from a distance (2 bytes, MSB first)
+//                      back in pixels, the copy may overlap the pixels it makes
+// The client stops decoding a line when it has the line width of pixels.
+
+// Read a pixel as a 32 bit value for comparisons
+static inline uint32_t screenPixel(const uint8_t *buf, uint32_t i, uint8_t bytes)
+{
+  if (bytes == 2) return ((const uint16_t *)buf)[i];
+  buf += 3 * i;
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16);
+}
+
+// Add literal pixels to the output, 128 at most per code
+static uint8_t *screenLiterals(uint8_t *out, const uint8_t *pix, uint32_t n, uint8_t bytes)
+{
+  while (n)
+  {
+    uint8_t count = n > 128 ? 128 : n;
+    *out++ = count - 1;
+    memcpy(out, pix, count * bytes);
+    out += count * bytes;
+    pix += count * bytes;
+    n -= count;
+  }
+  return out;
+}
+
+// Run length code a line of w pixels, returns the number of bytes written to out
+static uint32_t screenRle(const uint8_t *line, uint16_t w, uint8_t bytes, uint8_t *out)
+{
+  uint8_t *start = out;
+  uint16_t lit = 0; // First pixel not yet sent
+  uint16_t x = 0;
+
+  while (x < w)
+  {
+    uint32_t c = screenPixel(line, x, bytes);
+    uint16_t run = 1;
+    while (x + run < w && run < 128 && screenPixel(line, x + run, bytes) == c) run++;
+
+    // Two or more of the same pixel take fewer bytes as a run
+    if (run > 1)
+    {
+      out = screenLiterals(out, line + lit * bytes, x - lit, bytes);
+      *out++ = 0x80 | (run - 1);
+      memcpy(out, line + x * bytes, bytes);
+      out += bytes;
+      x += run;
+      lit = x;
+    }
+    else x++;
+  }
+  out = screenLiterals(out, line + lit * bytes, x - lit, bytes);
+
+  return out - start;
+}
+
+// LZ code the line held after the line above in win (2 x w pixels). Matches are looked
+// for in the line above at the same x, one pixel back (a run) and at the last place the
+// same two pixels were seen in this line, found with a 256 entry hash table
+static uint32_t screenLz(const uint8_t *win, uint16_t w, uint8_t bytes, uint8_t *out, uint16_t *hash)
+{
+  uint8_t *start = out;
+  uint32_t lit = w; // Window index of the first pixel not yet sent
+  uint32_t end = 2 * w;
+  uint32_t p = w;
+
+  memset(hash, 0, 256 * sizeof(uint16_t)); // 0 = none, line pixels have indexes >= w
+
+  while (p < end)
+  {
+    uint32_t max = end - p;
+    if (max > 64) max = 64;
+
+    // Copy from the line above, costs 1 byte
+    uint32_t above = 0;
+    while (above < max && screenPixel(win, p + above, bytes) == screenPixel(win, p + above - w, bytes)) above++;
+
+    // Copy from back in the window, costs 3 bytes
+    uint32_t len = 0, from = 0;
+    uint32_t cand[2] = { p - 1, 0 };
+    if (p + 1 < end)
+    {
+      uint32_t h = (screenPixel(win, p, bytes) * 2654435761u + screenPixel(win, p + 1, bytes)) * 2654435761u >> 24;
+      cand[1] = hash[h];
+      hash[h] = p;
+    }
+    for (uint8_t i = 0; i < 2; i++)
+    {
+      uint32_t q = cand[i];
+      if (q == 0 || q >= p) continue;
+      uint32_t n = 0;
+      while (n < max && screenPixel(win, q + n, bytes) == screenPixel(win, p + n, bytes)) n++;
+      if (n > len) { len = n; from = q; }
+    }
+
+    // Take whichever saves more bytes
+    int32_t saveAbove = above ? above * bytes - 1 : 0;
+    int32_t saveLen   = len > 1 ? len * bytes - 3 : 0;
+    if (saveAbove > 0 && saveAbove >= saveLen)
+    {
+      out = screenLiterals(out, win + lit * bytes, p - lit, bytes);
+      *out++ = 0x80 | (above - 1);
+      p += above;
+      lit = p;
+    }
+    else if (saveLen > 0)
+    {
+      out = screenLiterals(out, win + lit * bytes, p - lit, bytes);
+      uint32_t d = p - from;
+      *out++ = 0xC0 | (len - 1);
+      *out++ = d >> 8;
+      *out++ = d & 0xFF;
+      p += len;
+      lit = p;
+    }
+    else p++;
+  }
+  out = screenLiterals(out, win + lit * bytes, p - lit, bytes);
+
+  return out - start;
+}
+
+//====================================================================================
+//        Serial server protocol 2, lines sent as the client grants credit
+//====================================================================================
+// After the header the client grants lines with 'G' n (n = 1-255 lines) and may grant
+// more at any time, 'X' aborts. Each line is read with one readRect() call (or
+// readRectRGB() for 24 bit pixels), or taken from the Sprite, compressed if agreed,
+// and sent as soon as there is credit for it, so if the client keeps lines granted
+// ahead the capture runs at the link speed
+bool TFT_eFEX::serialScreenStream(uint8_t compression, TFT_eSprite *spr)
+{
+#if defined BITS_PER_PIXEL && BITS_PER_PIXEL >= 24
+  const uint8_t bytes = 3;
+#else
+  const uint8_t bytes = 2;
+#endif
+  uint16_t w = spr ? spr->width()  : _tft->width();
+  uint16_t h = spr ? spr->height() : _tft->height();
+
+  // LZ hash table, line above and line for LZ, and the compressed line (2 byte length,
+  // worst case is all literals)
+  uint32_t lineSize = w * bytes;
+  uint32_t outSize  = 2 + lineSize + (w + 127) / 128;
+  uint16_t *hash = (uint16_t *)calloc(512 + 2 * lineSize + outSize, 1);
+  if (!hash) return false; // The client times out
+  uint8_t  *win  = (uint8_t *)hash + 512;
+  uint8_t  *line = win + lineSize;
+  uint8_t  *out  = line + lineSize;
+
+  uint32_t credit = 0;
+  uint32_t waitTime = millis(); // Start of the wait for credit
+  uint32_t timeout = START_TIMEOUT; // Allow for the client reading the header before the first grant
+  bool result = true;
+
+  for (uint16_t y = 0; y < h && result; y++)
+  {
+    // Take the commands that have arrived, waiting for more if there is no credit
+    while (true)
+    {
+      delay(0); // Equivalent to yield() for ESP8266;
+      int cmd = Serial.read();
+      if (cmd < 0)
+      {
+        if (credit) break;
+        if (millis() - waitTime > timeout) { result = false; break; }
+        continue;
+      }
+      if (cmd == 'X') { result = false; break; }
+      if (cmd == 'G')
+      {
+        while (Serial.available() == 0 && millis() - waitTime <= timeout) delay(0);
+        cmd = Serial.read();
+        if (cmd < 0) { result = false; break; }
+        credit += cmd;
+        waitTime = millis();
+        timeout = PIXEL_TIMEOUT;
+      }
+    }
+    if (!result) break;
+
+    // Uncompressed lines of a 16 bit Sprite are sent straight from the Sprite memory
+    if (compression == SCREEN_RAW && spr && bytes == 2 && spr->getColorDepth() == 16)
+    {
+      Serial.write((uint8_t *)spr->getPointer() + y * lineSize, lineSize);
+      credit--;
+      waitTime = millis();
+      continue;
+    }
+
+    screenLine(spr, 0, y, w, line, bytes);
+    if (compression == SCREEN_RLE || compression == SCREEN_LZ)
+    {
+      uint32_t n = (compression == SCREEN_RLE) ? screenRle(line, w, bytes, out + 2) : screenLz(win, w, bytes, out + 2, hash);
+      out[0] = n >> 8;
+      out[1] = n & 0xFF;
+      Serial.write(out, n + 2);
+      if (compression == SCREEN_LZ) memcpy(win, line, lineSize); // Becomes the line above
+    }
+    else Serial.write(line, lineSize);
+    credit--;
+    waitTime = millis();
+  }
+
+  free(hash);
+
+  if (result) Serial.flush(); // Make sure all pixel bytes have been despatched
+  else
+  {
+    // Clear the rest of an abort or stray grants
+    uint32_t clearTime = millis() + 50;
+    while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
+  }
+
+  return result;
+}
+
+//====================================================================================
+//           Fetch pixels from the TFT or a Sprite in the client's format
+//====================================================================================
+// w pixels from x,y as 565 MSB first (bytes = 2) or R, G, B (bytes = 3). Sprite pixels
+// are taken from the Sprite memory: 16 bit Sprites hold 565 MSB first already, 8 bit
+// (RGB332) pixels are expanded with color8to16() and readPixel() gives the colours of
+// other depths (bitmap colours or palette)
+void TFT_eFEX::screenLine(TFT_eSprite *spr, uint16_t x, uint16_t y, uint16_t w, uint8_t *buf, uint8_t bytes)
+{
+  if (spr == nullptr)
+  {
+    // 565 pixels are MSB first in memory as the client wants them
+    if (bytes == 3) _tft->readRectRGB(x, y, w, 1, buf);
+    else            _tft->readRect(x, y, w, 1, (uint16_t *)buf);
+    return;
+  }
+
+  uint8_t  depth  = spr->getColorDepth();
+  uint32_t offset = x + y * spr->width();
+
+  if (depth == 16 && bytes == 2)
+  {
+    memcpy(buf, (uint16_t *)spr->getPointer() + offset, 2 * w);
+    return;
+  }
+
+  for (uint16_t i = 0; i < w; i++)
+  {
+    uint16_t c;
+    if (depth == 16)
+    {
+      c = ((uint16_t *)spr->getPointer())[offset + i];
+      c = (c >> 8) | (c << 8);
+    }
+    else if (depth == 8) c = spr->color8to16(((uint8_t *)spr->getPointer())[offset + i]);
+    else c = spr->readPixel(x + i, y);
+
+    if (bytes == 3)
+    {
+      *buf++ = (c >> 8) & 0xF8;
+      *buf++ = (c >> 3) & 0xFC;
+      *buf++ = (c << 3) & 0xF8;
+    }
+    else
+    {
+      *buf++ = c >> 8;
+      *buf++ = c & 0xFF;
+    }
+  }
+}
+
+//====================================================================================
+//    Send screen size etc using a simple header with delimiters for client checks
+//====================================================================================
+// Protocol 2 adds 'V' and the version, then 'C' and the compression method, after the
+// bits per pixel. The size is the Sprite size if spr is not nullptr
+void TFT_eFEX::sendParameters(String filename, uint8_t version, uint8_t compression, TFT_eSprite *spr)
+{
+  uint16_t width  = spr ? spr->width()  : _tft->width();
+  uint16_t height = spr ? spr->height() : _tft->height();
+
+  Serial.write('W'); // Width
+  Serial.write(width  >> 8);
+  Serial.write(width  & 0xFF);
+
+  Serial.write('H'); // Height
+  Serial.write(height >> 8);
+  Serial.write(height & 0xFF);
+
+  Serial.write('Y'); // Bits per pixel (16 or 24)
+  if (NPIXELS > 1 || version > 1) Serial.write(BITS_PER_PIXEL);
+  else Serial.write(16); // readPixel() only provides 16 bit values
+
+  if (version > 1)
+  {
+    Serial.write('V'); // Protocol version
+    Serial.write(version);
+
+    Serial.write('C'); // Line compression, SCREEN_RAW, SCREEN_RLE or SCREEN_LZ
+    Serial.write(compression);
+  }
+
+  Serial.write('?'); // Filename next
+  Serial.print(filename);
+
+  Serial.write('.'); // End of filename marker
+
+  Serial.write(FILE_EXT); // Filename extension identifier
+
+  Serial.write(*FILE_TYPE); // First character defines file type j,b,p,t
+}
+
+
+/**************************************************************************/
+//
+//    Bodmer added native JPEG decoder functions from ESP32 rom utility
+//    Source: https://github.com/espressif/WROVER_KIT_LCD
+//
+/**************************************************************************/
+#ifdef ESP32
+
+// Include these in header file
+// #include "rom/tjpgd.h"
+// #include "FS.h"
+
+// Convert an RGB888 pixel to 565 in panel byte order (MSB first in memory), so the
+// pixels can be pushed to the TFT without a byte swap
+#define jpgColor(c) ((uint16_t)rgb565Pack(((uint8_t*)(c))[0], ((uint8_t*)(c))[1], ((uint8_t*)(c))[2], true))
+
+#define JPG_BLOCK_PIXELS 256 // Largest tjpgd output block, a 16x16 MCU
+
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_ERROR
+const char * jd_errors[] = {
+    "Succeeded",
+    "Interrupted by output function",
+    "Device error or wrong termination of input stream",
+    "Insufficient memory pool for the image",
+    "Insufficient stream input buffer",
+    "Parameter error",
+    "Data format error",
+    "Right format but not supported",
+    "Not supported JPEG standard"
+};
+#endif
+
+// Struct to pass parameters to jpeg decoder
+typedef struct {
+        int16_t x;             // Position on the TFT or Sprite, may be negative
+        int16_t y;
+        uint16_t maxWidth;
+        uint16_t maxHeight;
+        uint16_t offX;
+        uint16_t offY;
+        jpeg_div_t scale;
+        const void * src;
+        size_t len;
+        size_t index;
+        TFT_eSPI * tft;
+        uint16_t outWidth;
+        uint16_t outHeight;
+        bool inTransaction; // true if the caller already holds the TFT SPI transaction
+        uint8_t previewShift; // Preview pass: decode at 1/(1<<previewShift) of scale and enlarge
+        TFT_eSprite * spr;    // Render to this Sprite instead of the TFT if not nullptr
+        image_stats_t * stats; // Stage timing and counters, nullptr if not wanted
+        uint8_t * work;        // tjpgd work area, owned by the TFT_eFEX instance
+        uint32_t workSize;
+        uint16_t * dmaBuf[2];  // DMA ping-pong block buffers, set up by jpgDecode()
+        uint8_t dmaIndex;
+        uint8_t * readBuf;     // File read-ahead buffer, nullptr for unbuffered reads
+        uint32_t readSize;
+        uint32_t readPos;      // Index of the next unread byte in readBuf
+        uint32_t readFill;     // Number of valid bytes in readBuf
+        struct jpg_resample_t * resample; // Resize to fit a box, nullptr for power of 2 scaling only
+        JRESULT result;        // Set by jpgDecode(), JDR_FMT3 if the ROM decoder cannot decode the image
+        bool dither;           // Ordered dither to 565, see setColorDither()
+} jpg_file_decoder_t;
+
+// Box filter resampler state, the output rows overlapping the current band of
+// decoded blocks are held as channel sums until the band below is reached
+typedef struct jpg_resample_t {
+        uint16_t boxWidth;     // Box to fit the image in, aspect ratio is kept
+        uint16_t boxHeight;
+        uint16_t width;        // Output image size
+        uint16_t height;
+        uint32_t stepX;        // 16.16 fixed point source to output step
+        uint32_t stepY;
+        uint8_t  rows;         // Number of output rows held in sum
+        uint16_t nextRow;      // Next output row to send
+        int32_t  bandTop;      // Top of the band of blocks being decoded
+        uint16_t * sum;        // rows x width x 3 channel sums
+        uint8_t  * colCount;   // Source pixels summed into each output column
+        uint8_t  * rowCount;   // Source rows summed into each output row
+        uint8_t  * line;       // One averaged RGB888 output row
+        uint16_t * pix;        // One converted output row
+        uint16_t clipLeft;     // Output columns and rows that land on the Sprite or screen
+        uint16_t clipRight;
+        int32_t  clipBottom;
+} jpg_resample_t;
+
+/**************************************************************************/
+//
+//    JPEG decoder support function prototypes
+//
+/**************************************************************************/
+static void     jpgReadBuffer(jpg_file_decoder_t * jpeg, uint32_t size);
+static uint32_t jpgReadFile(JDEC *decoder, uint8_t *buf, uint32_t len);
+static uint32_t jpgRead(JDEC *decoder, uint8_t *buf, uint32_t len);
+static uint32_t jpgWrite(JDEC *decoder, void *bitmap, JRECT *rect);
+static uint32_t jpgWritePreview(JDEC *decoder, void *bitmap, JRECT *rect);
+static uint32_t jpgWriteResample(JDEC *decoder, void *bitmap, JRECT *rect);
+static bool     jpgResampleSetup(jpg_file_decoder_t * jpeg, JDEC * decoder);
+static void     jpgResampleFlush(jpg_file_decoder_t * jpeg, uint16_t end);
+static bool     jpgDecode(jpg_file_decoder_t * jpeg, uint32_t(* reader)(JDEC*,uint8_t *, uint32_t));
+
+
+/**************************************************************************/
+/*!
+    @brief  Decode an array stored FLASH in memory (ESP32 only)
+    @param    Array name
+    @param    Size of array, use sizeof(array_name)
+    @param    Display x coord to draw at, may be negative
+    @param    Display y coord to draw at, may be negative
+    @param    Optional: Unscaled jpeg maximum width in pixels
+    @param    Optional: Unscaled jpeg maximum height in pixels
+    @param    Optional: Unscaled jpeg start x coordinate offset in jpeg
+    @param    Optional: Unscaled jpeg start y coordinate offset in jpeg
+    @param    Optional: Scale factor 0-4 (type jpeg_div_t)
+    @param    Optional: Pointer to image_stats_t for timing and counters
+    @param    Optional: Sprite to draw into instead of the TFT
+    @return   true if decoded, else false
+*/
+/**************************************************************************/
+// e.g tft.drawJpg(EagleEye, sizeof(EagleEye), 0, 10);
+// Where EagleEye is an array of bytes in PROGMEM:
+// const uint8_t EagleEye[] PROGMEM = {...};
+bool TFT_eFEX::drawJpg(const uint8_t * jpg_data, size_t jpg_len, int16_t x, int16_t y, uint16_t maxWidth, uint16_t maxHeight, uint16_t offX, uint16_t offY, jpeg_div_t scale, image_stats_t *stats, TFT_eSprite *spr){
+
+    if(stats) memset(stats, 0, sizeof(image_stats_t));
+    uint32_t startTime = micros();
+
+    // 0 means no limit, the image is clipped to the Sprite or screen by jpgDecode()
+    maxWidth = maxWidth ? maxWidth>>(uint8_t)scale : 0xFFFF;
+    maxHeight = maxHeight ? maxHeight>>(uint8_t)scale : 0xFFFF;
+
+    jpg_file_decoder_t jpeg;
+
+    jpeg.src = jpg_data;
+    jpeg.len = jpg_len;
+    jpeg.index = 0;
+    jpeg.x = x;
+    jpeg.y = y;
+    jpeg.maxWidth = maxWidth;
+    jpeg.maxHeight = maxHeight;
+    jpeg.offX = offX>>(uint8_t)scale;
+    jpeg.offY = offY>>(uint8_t)scale;
+    jpeg.scale = scale;
+    jpeg.tft = _tft;
+    jpeg.inTransaction = false;
+    jpeg.previewShift = 0;
+    jpeg.spr = spr;
+    jpeg.stats = stats;
+    jpeg.work = jpgWorkBuffer();
+    jpeg.workSize = jpg_work_size;
+    jpgReadBuffer(&jpeg, 0);
+    jpeg.resample = nullptr;
+    jpeg.dither = color_dither;
+
+    // Paint a coarse DC only preview first, then refine it to full resolution
+    // (not for Sprites, nothing is seen until the Sprite is pushed)
+    bool result = true;
+    if(jpg_preview && !spr && scale < JPEG_DIV_8){
+        jpeg.previewShift = (uint8_t)JPEG_DIV_8 - (uint8_t)scale;
+        result = jpgDecode(&jpeg, jpgRead);
+        jpeg.index = 0;
+        jpeg.previewShift = 0;
+    }
+
+    if(result) result = jpgDecode(&jpeg, jpgRead);
+
+    // The ROM decoder only handles colour images, grayscale ones take the bundled decoder's Y only path
+    if(!result && jpeg.result == JDR_FMT3 && scale <= JPEG_DIV_8){
+        result = jpegRender(nullptr, jpg_data, jpg_len, x, y, spr, stats, (uint8_t)scale,
+                            maxWidth, maxHeight, false, offX>>(uint8_t)scale, offY>>(uint8_t)scale);
+    }
+
+    if(stats) stats->totalTime = micros() - startTime;
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decode an array stored as a file (ESP32 only)
+    @param    Filing system, e.g. SPIFFS
+    @param    File name, precede with / for SPIFFS
+    @param    Display x coord to draw at, may be negative
+    @param    Display y coord to draw at, may be negative
+    @param    Optional: Unscaled jpeg maximum width in pixels
+    @param    Optional: Unscaled jpeg maximum height in pixels
+    @param    Optional: Unscaled jpeg start x coordinate offset in jpeg
+    @param    Optional: Unscaled jpeg start y coordinate offset in jpeg
+    @param    Optional: Scale factor 0-4 (type jpeg_div_t)
+    @param    Optional: Pointer to image_stats_t for timing and counters
+    @param    Optional: Sprite to draw into instead of the TFT
+    @return   true if decoded, else false
+*/
+/**************************************************************************/
+// e.g. tft.drawJpgFile(SPIFFS, "/EagleEye.jpg", 0, 10);
+bool TFT_eFEX::drawJpgFile(fs::FS &fs, const char * path, int16_t x, int16_t y, uint16_t maxWidth, uint16_t maxHeight, uint16_t offX, uint16_t offY, jpeg_div_t scale, image_stats_t *stats, TFT_eSprite *spr){
+
+    if(stats) memset(stats, 0, sizeof(image_stats_t));
+    uint32_t startTime = micros();
+
+    // 0 means no limit, the image is clipped to the Sprite or screen by jpgDecode()
+    maxWidth = maxWidth ? maxWidth>>(uint8_t)scale : 0xFFFF;
+    maxHeight = maxHeight ? maxHeight>>(uint8_t)scale : 0xFFFF;
+
+    fs::File file = fs.open(path, "r");
+    if(!file){
+        log_e("Failed to open file for reading");
+        return false;
+    }
+
+    jpg_file_decoder_t jpeg;
+
+    jpeg.src = &file;
+    jpeg.len = file.size();
+    jpeg.index = 0;
+    jpeg.x = x;
+    jpeg.y = y;
+    jpeg.maxWidth = maxWidth;
+    jpeg.maxHeight = maxHeight;
+    jpeg.offX = offX>>(uint8_t)scale;
+    jpeg.offY = offY>>(uint8_t)scale;
+    jpeg.scale = scale;
+    jpeg.tft = _tft;
+    jpeg.inTransaction = false;
+    jpeg.previewShift = 0;
+    jpeg.spr = spr;
+    jpeg.stats = stats;
+    jpeg.work = jpgWorkBuffer();
+    jpeg.workSize = jpg_work_size;
+    jpgReadBuffer(&jpeg, jpg_read_size);
+    jpeg.resample = nullptr;
+    jpeg.dither = color_dither;
+
+    // Paint a coarse DC only preview first, then refine it to full resolution
+    // (not for Sprites, nothing is seen until the Sprite is pushed)
+    bool result = true;
+    if(jpg_preview && !spr && scale < JPEG_DIV_8){
+        jpeg.previewShift = (uint8_t)JPEG_DIV_8 - (uint8_t)scale;
+        result = jpgDecode(&jpeg, jpgReadFile);
+        file.seek(0);
+        jpeg.readPos = 0;
+        jpeg.readFill = 0;
+        jpeg.previewShift = 0;
+    }
+
+    if(result) result = jpgDecode(&jpeg, jpgReadFile);
+
+    free(jpeg.readBuf);
+
+    // The ROM decoder only handles colour images, grayscale ones take the bundled decoder's Y only path
+    if(!result && jpeg.result == JDR_FMT3 && scale <= JPEG_DIV_8){
+        file.seek(0);
+        result = jpegRender(&file, nullptr, file.size(), x, y, spr, stats, (uint8_t)scale,
+                            maxWidth, maxHeight, false, offX>>(uint8_t)scale, offY>>(uint8_t)scale);
+    }
+
+    file.close();
+
+    if(stats) stats->totalTime = micros() - startTime;
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decode an array stored in FLASH resized to fit a box (ESP32 only)
+    @param    Array name
+    @param    Size of array, use sizeof(array_name)
+    @param    Display x coord to draw at, may be negative
+    @param    Display y coord to draw at, may be negative
+    @param    Optional: Box width, 0 to fit the screen (or Sprite) right of x
+    @param    Optional: Box height, 0 to fit the screen (or Sprite) below y
+    @param    Optional: Sprite to draw into instead of the TFT
+    @param    Optional: Pointer to image_stats_t for timing and counters
+    @return   true if decoded, else false
+*/
+/**************************************************************************/
+// The aspect ratio is kept and images are not enlarged. The decoder scales by
+// the largest power of 2 that keeps the image at least as big as the box, then
+// a box filter resizes it the rest of the way. As with drawJpg() the box may be
+// partly off the screen (or Sprite), only the visible part is drawn
+// e.g. fex.drawJpgScaled(EagleEye, sizeof(EagleEye), 0, 0, 200, 150);
+bool TFT_eFEX::drawJpgScaled(const uint8_t * jpg_data, size_t jpg_len, int16_t x, int16_t y, uint16_t width, uint16_t height, TFT_eSprite *spr, image_stats_t *stats){
+
+    if(stats) memset(stats, 0, sizeof(image_stats_t));
+    uint32_t startTime = micros();
+
+    int16_t dispWidth  = spr ? spr->width()  : _tft->width();
+    int16_t dispHeight = spr ? spr->height() : _tft->height();
+
+    // The resized image is clipped to the Sprite or screen by jpgResampleFlush()
+    if(x >= dispWidth || y >= dispHeight){
+        return true;
+    }
+
+    jpg_resample_t resample;
+    resample.boxWidth = width ? width : dispWidth - x;
+    resample.boxHeight = height ? height : dispHeight - y;
+
+    jpg_file_decoder_t jpeg;
+
+    jpeg.src = jpg_data;
+    jpeg.len = jpg_len;
+    jpeg.index = 0;
+    jpeg.x = x;
+    jpeg.y = y;
+    jpeg.maxWidth = resample.boxWidth;
+    jpeg.maxHeight = resample.boxHeight;
+    jpeg.offX = 0;
+    jpeg.offY = 0;
+    jpeg.scale = JPEG_DIV_NONE; // Chosen by jpgDecode() from the image header
+    jpeg.tft = _tft;
+    jpeg.inTransaction = false;
+    jpeg.previewShift = 0;
+    jpeg.spr = spr;
+    jpeg.stats = stats;
+    jpeg.work = jpgWorkBuffer();
+    jpeg.workSize = jpg_work_size;
+    jpgReadBuffer(&jpeg, 0);
+    jpeg.resample = &resample;
+    jpeg.dither = color_dither;
+
+    bool result = jpgDecode(&jpeg, jpgRead);
+
+    if(stats) stats->totalTime = micros() - startTime;
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decode a jpeg file resized to fit a box (ESP32 only)
+    @param    Filing system, e.g. SPIFFS
+    @param    File name, precede with / for SPIFFS
+    @param    Display x coord to draw at, may be negative
+    @param    Display y coord to draw at, may be negative
+    @param    Optional: Box width, 0 to fit the screen (or Sprite) right of x
+    @param    Optional: Box height, 0 to fit the screen (or Sprite) below y
+    @param    Optional: Sprite to draw into instead of the TFT
+    @param    Optional: Pointer to image_stats_t for timing and counters
+    @return   true if decoded, else false
+*/
+/**************************************************************************/
+// e.g. fex.drawJpgFileScaled(SPIFFS, "/Baboon.jpg", 0, 0); // Fit the screen
+bool TFT_eFEX::drawJpgFileScaled(fs::FS &fs, const char * path, int16_t x, int16_t y, uint16_t width, uint16_t height, TFT_eSprite *spr, image_stats_t *stats){
+
+    if(stats) memset(stats, 0, sizeof(image_stats_t));
+    uint32_t startTime = micros();
+
+    int16_t dispWidth  = spr ? spr->width()  : _tft->width();
+    int16_t dispHeight = spr ? spr->height() : _tft->height();
+
+    // The resized image is clipped to the Sprite or screen by jpgResampleFlush()
+    if(x >= dispWidth || y >= dispHeight){
+        return true;
+    }
+
+    fs::File file = fs.open(path, "r");
+    if(!file){
+        log_e("Failed to open file for reading");
+        return false;
+    }
+
+    jpg_resample_t resample;
+    resample.boxWidth = width ? width : dispWidth - x;
+    resample.boxHeight = height ? height : dispHeight - y;
+
+    jpg_file_decoder_t jpeg;
+
+    jpeg.src = &file;
+    jpeg.len = file.size();
+    jpeg.index = 0;
+    jpeg.x = x;
+    jpeg.y = y;
+    jpeg.maxWidth = resample.boxWidth;
+    jpeg.maxHeight = resample.boxHeight;
+    jpeg.offX = 0;
+    jpeg.offY = 0;
+    jpeg.scale = JPEG_DIV_NONE; // Chosen by jpgDecode() from the image header
+    jpeg.tft = _tft;
+    jpeg.inTransaction = false;
+    jpeg.previewShift = 0;
+    jpeg.spr = spr;
+    jpeg.stats = stats;
+    jpeg.work = jpgWorkBuffer();
+    jpeg.workSize = jpg_work_size;
+    jpgReadBuffer(&jpeg, jpg_read_size);
+    jpeg.resample = &resample;
+    jpeg.dither = color_dither;
+
+    bool result = jpgDecode(&jpeg, jpgReadFile);
+
+    free(jpeg.readBuf);
+    file.close();
+
+    if(stats) stats->totalTime = micros() - startTime;
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable two pass drawing in drawJpg() and drawJpgFile() (ESP32 only)
+    @param    true = paint a DC only 1/8 scale preview enlarged to the output
+              rectangle, then redraw it at the requested scale
+*/
+/**************************************************************************/
+// Reduces the time to the first meaningful image on screen for large jpegs,
+// at the cost of a small increase in total drawing time
+void TFT_eFEX::setJpgPreview(bool enable){
+    jpg_preview = enable;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set the work buffer used by the native decoder (ESP32 only)
+    @param    Buffer owned by the caller, or nullptr to allocate one
+    @param    Size of the buffer in bytes (JPG_WORK_SIZE minimum)
+    @return   true if the buffer is available
+*/
+/**************************************************************************/
+// Each TFT_eFEX instance has its own work buffer, so two instances can decode
+// at the same time in different FreeRTOS tasks, e.g. each into its own Sprite.
+// A larger buffer allows images with more Huffman and quantisation tables.
+bool TFT_eFEX::setJpgWorkBuffer(uint8_t *buf, uint32_t size){
+    if(size < JPG_WORK_SIZE){
+        log_e("Work buffer too small");
+        return false;
+    }
+    if(jpg_work_owned) free(jpg_work);
+    jpg_work_owned = (buf == nullptr);
+    if(buf == nullptr) buf = (uint8_t *)malloc(size);
+    jpg_work = buf;
+    jpg_work_size = size;
+    return buf != nullptr;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set the file read-ahead buffer size for the native decoder (ESP32 only)
+    @param    Size in bytes, typically 4096 to 16384, 0 for unbuffered reads
+*/
+/**************************************************************************/
+// The buffer is allocated for the duration of each drawJpgFile() call, the
+// time saved can be seen in the readTime reported in image_stats_t
+void TFT_eFEX::setJpgReadBuffer(uint32_t size){
+    jpg_read_size = size;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the work buffer, allocating the default on first use
+*/
+/**************************************************************************/
+uint8_t * TFT_eFEX::jpgWorkBuffer(void){
+    if(jpg_work == nullptr){
+        jpg_work = (uint8_t *)malloc(jpg_work_size);
+        jpg_work_owned = true;
+    }
+    return jpg_work;
+}
+
+/**************************************************************************/
+//
+//    JPEG decoder support functions
+//
+/**************************************************************************/
+// Allocate a read-ahead buffer for a file source, reads are unbuffered if size is 0
+// or the allocation fails
+static void jpgReadBuffer(jpg_file_decoder_t * jpeg, uint32_t size){
+    jpeg->readBuf = size ? (uint8_t *)malloc(size) : nullptr;
+    jpeg->readSize = jpeg->readBuf ? size : 0;
+    jpeg->readPos = 0;
+    jpeg->readFill = 0;
+}
+
+// The decoder asks for small reads (up to 512 bytes) and skips. With a read-ahead
+// buffer these are served from RAM and the file is read in readSize chunks
+static uint32_t jpgReadFile(JDEC *decoder, uint8_t *buf, uint32_t len){
+    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
+    fs::File * file = (fs::File *)jpeg->src;
+    uint32_t t = jpeg->stats ? micros() : 0;
+    if(jpeg->readBuf){
+        uint32_t done = 0;
+        while(done < len){
+            if(jpeg->readPos == jpeg->readFill){
+                // A skip beyond the buffered data is a seek rather than a read
+                if(!buf && (len - done) >= jpeg->readSize){
+                    file->seek(len - done, fs::SeekCur);
+                    done = len;
+                    break;
+                }
+                jpeg->readFill = file->read(jpeg->readBuf, jpeg->readSize);
+                jpeg->readPos = 0;
+                if(!jpeg->readFill) break; // End of file
+            }
+            uint32_t n = jpeg->readFill - jpeg->readPos;
+            if(n > len - done) n = len - done;
+            if(buf){
+                memcpy(buf + done, jpeg->readBuf + jpeg->readPos, n);
+            }
+            jpeg->readPos += n;
+            done += n;
+        }
+        len = done;
+    } else if(buf){
+        len = file->read(buf, len);
+    } else {
+        file->seek(len, fs::SeekCur);
+    }
+    if(jpeg->stats){
+        jpeg->stats->readTime += micros() - t;
+        jpeg->stats->bytesRead += len;
+    }
+    return len;
+}
+
+static uint32_t jpgRead(JDEC *decoder, uint8_t *buf, uint32_t len){
+    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
+    uint32_t t = jpeg->stats ? micros() : 0;
+    if(buf){
+        memcpy(buf, (const uint8_t *)jpeg->src + jpeg->index, len);
+    }
+    jpeg->index += len;
+    if(jpeg->stats){
+        jpeg->stats->readTime += micros() - t;
+        jpeg->stats->bytesRead += len;
+    }
+    return len;
+}
+
+// Convert n RGB888 pixels to 565 in panel byte order with the shared converter, four
+// pixels at a time when both buffers are word aligned (see TFT_eFEX_Color.h)
+static inline void jpgConvert(const uint8_t *src, uint16_t *dst, uint32_t n){
+    rgb565Row(src, dst, n, false, true);
+}
+
+// Push converted pixels to the TFT, timing the push if stats are wanted
+static void jpgPush(jpg_file_decoder_t * jpeg, uint16_t *pixBuf, uint32_t len){
+    if(jpeg->stats){
+        uint32_t t = micros();
+        jpeg->tft->pushColors(pixBuf, len, false);
+        jpeg->stats->pushTime += micros() - t;
+        jpeg->stats->pixels += len;
+    }
+    else jpeg->tft->pushColors(pixBuf, len, false);
+}
+
+// Colour conversion time is the time in the output function less the push time
+static void jpgConvertTime(jpg_file_decoder_t * jpeg, uint32_t start, uint32_t pushTime){
+    if(jpeg->stats){
+        jpeg->stats->convertTime += (micros() - start) - (jpeg->stats->pushTime - pushTime);
+    }
+}
+
+// Write rows of decoded RGB888 pixels straight into the Sprite frame buffer,
+// stride is the number of pixels from one source row to the next
+static void jpgSpriteRows(jpg_file_decoder_t * jpeg, uint8_t *data, uint16_t stride, int16_t dx, int16_t dy, uint16_t dw, uint16_t h){
+    int16_t sprWidth = jpeg->spr->width();
+    uint8_t depth = jpeg->spr->getColorDepth();
+    uint32_t offset = dx + dy * sprWidth;
+
+    for(uint16_t row = 0; row < h; row++){
+        // 16 bit Sprites hold pixels in panel byte order, 8 bit Sprites hold RGB332
+        if(depth == 16){
+            uint16_t *img = (uint16_t *)jpeg->spr->getPointer() + offset;
+            if(jpeg->dither) rgb565DitherRow(data, img, dw, dx, dy + row, false, true);
+            else jpgConvert(data, img, dw);
+        }
+        else if(depth == 8){
+            uint8_t *img = (uint8_t *)jpeg->spr->getPointer() + offset;
+            for(uint16_t col = 0; col < dw; col++){
+                uint8_t *rgb = data + 3 * col;
+                img[col] = (rgb[0] & 0xE0) | ((rgb[1] & 0xE0) >> 3) | (rgb[2] >> 6);
+            }
+        }
+        else {
+            for(uint16_t col = 0; col < dw; col++){
+                uint16_t color = jpgColor(data + 3 * col);
+                jpeg->spr->drawPixel(dx + col, dy + row, (color >> 8) | (color << 8));
+            }
+        }
+        data += 3 * stride;
+        offset += sprWidth;
+    }
+    if(jpeg->stats) jpeg->stats->pixels += dw * h;
+}
+
+static uint32_t jpgWrite(JDEC *decoder, void *bitmap, JRECT *rect){
+    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
+    uint32_t start = 0, pushTime = 0;
+    if(jpeg->stats){
+        start = micros();
+        pushTime = jpeg->stats->pushTime;
+        jpeg->stats->blocks++;
+    }
+    uint16_t x = rect->left;
+    uint16_t y = rect->top;
+    uint16_t w = rect->right + 1 - x;
+    uint16_t h = rect->bottom + 1 - y;
+    uint16_t oL = 0, oR = 0;
+    uint8_t *data = (uint8_t *)bitmap;
+
+    // Blocks arrive top to bottom, so once below the crop window the rest of the
+    // image is not needed. Returning 0 stops the decoder (jpgDecode treats it as done)
+    if(rect->top >= (jpeg->offY + jpeg->outHeight)){
+        return 0;
+    }
+    if(rect->right < jpeg->offX){
+        return 1;
+    }
+    if(rect->left >= (jpeg->offX + jpeg->outWidth)){
+        return 1;
+    }
+    if(rect->bottom < jpeg->offY){
+        return 1;
+    }
+    if(rect->top < jpeg->offY){
+        uint16_t linesToSkip = jpeg->offY - rect->top;
+        data += linesToSkip * w * 3;
+        h -= linesToSkip;
+        y += linesToSkip;
+    }
+    if(rect->bottom >= (jpeg->offY + jpeg->outHeight)){
+        uint16_t linesToSkip = (rect->bottom + 1) - (jpeg->offY + jpeg->outHeight);
+        h -= linesToSkip;
+    }
+    if(rect->left < jpeg->offX){
+        oL = jpeg->offX - rect->left;
+    }
+    if(rect->right >= (jpeg->offX + jpeg->outWidth)){
+        oR = (rect->right + 1) - (jpeg->offX + jpeg->outWidth);
+    }
+
+    uint16_t dw = w - (oL + oR);
+    int16_t dx = x - jpeg->offX + jpeg->x + oL;
+    int16_t dy = y - jpeg->offY + jpeg->y;
+    data += 3 * oL;
+
+    if(jpeg->spr){
+        jpgSpriteRows(jpeg, data, w, dx, dy, dw, h);
+        jpgConvertTime(jpeg, start, pushTime);
+        return 1;
+    }
+
+    // Convert the whole cropped block, then send it in one push
+    uint16_t blockBuf[JPG_BLOCK_PIXELS];
+    uint16_t *pixBuf = jpeg->dmaBuf[0] ? jpeg->dmaBuf[jpeg->dmaIndex] : blockBuf;
+    uint16_t *pix = pixBuf;
+
+    for(uint16_t row = 0; row < h; row++){
+        if(jpeg->dither) rgb565DitherRow(data, pix, dw, dx, dy + row, false, true);
+        else jpgConvert(data, pix, dw);
+        data += 3 * w;
+        pix += dw;
+    }
+
+#ifdef JPG_USE_DMA
+    if(jpeg->dmaBuf[0]){
+        // Send this block while the next one is decoded into the other buffer
+        uint32_t t = jpeg->stats ? micros() : 0;
+        jpeg->tft->pushImageDMA(dx, dy, dw, h, pixBuf);
+        jpeg->dmaIndex ^= 1;
+        if(jpeg->stats){
+            jpeg->stats->pushTime += micros() - t;
+            jpeg->stats->pixels += dw * h;
+        }
+        jpgConvertTime(jpeg, start, pushTime);
+        return 1;
+    }
+#endif
+
+    if(!jpeg->inTransaction) jpeg->tft->startWrite();
+    jpeg->tft->setAddrWindow(dx, dy, dw, h);
+    jpgPush(jpeg, pixBuf, dw * h);
+    if(!jpeg->inTransaction) jpeg->tft->endWrite();
+    jpgConvertTime(jpeg, start, pushTime);
+    return 1;
+}
+
+// Output function for the preview pass, each pixel decoded at the reduced scale is
+// enlarged to a (1<<previewShift) square and clipped by the same crop window as jpgWrite
+static uint32_t jpgWritePreview(JDEC *decoder, void *bitmap, JRECT *rect){
+    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
+    uint32_t start = 0, pushTime = 0;
+    if(jpeg->stats){
+        start = micros();
+        pushTime = jpeg->stats->pushTime;
+        jpeg->stats->blocks++;
     }
-  }
-  return false;
+    uint8_t shift = jpeg->previewShift;
+    uint16_t w = rect->right + 1 - rect->left;
+    uint8_t *data = (uint8_t *)bitmap;
+
+    // Stop the decoder once below the crop window
+    if((rect->top << shift) >= (jpeg->offY + jpeg->outHeight)){
+        return 0;
+    }
+
+    // Block area in output scale coordinates, clipped to the crop window
+    int32_t x0 = rect->left << shift;
+    int32_t x1 = (rect->right + 1) << shift;
+    int32_t y0 = rect->top << shift;
+    int32_t y1 = (rect->bottom + 1) << shift;
+
+    if(x0 < jpeg->offX) x0 = jpeg->offX;
+    if(y0 < jpeg->offY) y0 = jpeg->offY;
+    if(x1 > jpeg->offX + jpeg->outWidth) x1 = jpeg->offX + jpeg->outWidth;
+    if(y1 > jpeg->offY + jpeg->outHeight) y1 = jpeg->offY + jpeg->outHeight;
+
+    if(x0 >= x1 || y0 >= y1){
+        return 1;
+    }
+
+    uint16_t dw = x1 - x0;
+    uint16_t dh = y1 - y0;
+    int16_t dx = x0 - jpeg->offX + jpeg->x;
+    int16_t dy = y0 - jpeg->offY + jpeg->y;
+
+    // An enlarged block is the size of a full scale MCU, at most 16 x 16 pixels. Each
+    // row is enlarged as RGB888 and converted as jpgWrite() does, so the preview has
+    // the same colours (and dither pattern) as the full resolution pass
+    uint16_t blockBuf[JPG_BLOCK_PIXELS];
+    uint8_t rgb[16 * 3] __attribute__((aligned(4)));
+    uint16_t *pix = blockBuf;
+
+    for(int32_t y = y0; y < y1; y++, pix += dw){
+        // Without dithering the rows enlarged from one decoded row are the same
+        if(!jpeg->dither && y > y0 && (y >> shift) == ((y - 1) >> shift)){
+            memcpy(pix, pix - dw, dw * sizeof(uint16_t));
+            continue;
+        }
+        uint8_t *line = data + ((y >> shift) - rect->top) * w * 3;
+        for(int32_t x = x0; x < x1; x++){
+            memcpy(rgb + 3 * (x - x0), line + ((x >> shift) - rect->left) * 3, 3);
+        }
+        if(jpeg->dither) rgb565DitherRow(rgb, pix, dw, dx, dy + (y - y0), false, true);
+        else jpgConvert(rgb, pix, dw);
+    }
+
+    if(!jpeg->inTransaction) jpeg->tft->startWrite();
+    jpeg->tft->setAddrWindow(dx, dy, dw, dh);
+    jpgPush(jpeg, blockBuf, dw * dh);
+    if(!jpeg->inTransaction) jpeg->tft->endWrite();
+    jpgConvertTime(jpeg, start, pushTime);
+    return 1;
 }
-/***************************************************************************************
-** Function name:           Location
-** Description:             Find the location of the current letter
-***************************************************************************************/
-uint8_t Location(uint16_t ch, uint16_t NextChar, uint16_t PrevChar)
-{
-  /*
-  ('<isolated>', '<initial>', '<medial>', '<final>')
-    */
-  uint8_t stat;
-  bool p = isFrom(PrevChar, INITIAL);
-  bool n = isFrom(NextChar, FINAL);
-  // Serial.print("$");
-  // Serial.print(NextChar);
-  // Serial.print("$");
-  // Serial.print(PrevChar);
-  // Serial.print("$");
-  // Serial.print(PrevChar -  0x0620);
-  // Serial.print("P");
-  // Serial.println((String) p + (String) n );
 
-  if (p) // initail
-  {
-    if (n) // end
-      stat = MEDIAL; 
-    else
-      stat = FINAL;
-  }
-  else if (n)
-    stat = INITIAL; //Final
-  else
-    stat = ISOLATED; //Medial
-  
+// Map a source coordinate to an output coordinate
+static inline uint16_t jpgResampleMap(uint32_t v, uint32_t step, uint16_t n){
+    uint32_t o = (v * step) >> 16;
+    return (o < n) ? o : n - 1;
+}
 
-  return stat;
+// Pick the output size and power of 2 scale from the image header, then allocate
+// the row sums. Returns false if the box is too small or memory runs out
+static bool jpgResampleSetup(jpg_file_decoder_t * jpeg, JDEC * decoder){
+    jpg_resample_t * rs = jpeg->resample;
+
+    // Fit the box keeping the aspect ratio, never enlarging the image
+    uint32_t w = rs->boxWidth, h = rs->boxHeight;
+    if(w * decoder->height > h * decoder->width) w = (h * decoder->width) / decoder->height;
+    else h = (w * decoder->height) / decoder->width;
+    if(w > decoder->width || h > decoder->height){
+        w = decoder->width;
+        h = decoder->height;
+    }
+    if(!w) w = 1;
+    if(!h) h = 1;
+
+    // Largest power of 2 reduction still at least the output size
+    uint8_t scale = 0;
+    while(scale < (uint8_t)JPEG_DIV_8 && (decoder->width >> (scale + 1)) >= w && (decoder->height >> (scale + 1)) >= h){
+        scale++;
+    }
+    jpeg->scale = (jpeg_div_t)scale;
+
+    uint16_t srcWidth = decoder->width >> scale;
+    uint16_t srcHeight = decoder->height >> scale;
+
+    rs->width = w;
+    rs->height = h;
+    rs->stepX = ((w << 16) + srcWidth - 1) / srcWidth;
+    rs->stepY = ((h << 16) + srcHeight - 1) / srcHeight;
+    rs->rows = (16 >> scale) + 1; // Tallest block band plus the row straddling bands
+    rs->nextRow = 0;
+    rs->bandTop = -1;
+
+    rs->sum = (uint16_t *)calloc(rs->rows * w * 3, sizeof(uint16_t));
+    rs->colCount = (uint8_t *)calloc(w + h, 1);
+    uint32_t lineSize = (w * 3 + 3) & ~3; // Keeps pix word aligned
+    rs->line = (uint8_t *)malloc(lineSize + w * sizeof(uint16_t));
+    if(!rs->sum || !rs->colCount || !rs->line){
+        free(rs->sum);
+        free(rs->colCount);
+        free(rs->line);
+        log_e("Failed to allocate resample buffers");
+        return false;
+    }
+    rs->rowCount = rs->colCount + w;
+    rs->pix = (uint16_t *)(rs->line + lineSize);
+
+    // Clip the output to the Sprite or screen
+    int32_t dispWidth  = jpeg->spr ? jpeg->spr->width()  : jpeg->tft->width();
+    int32_t dispHeight = jpeg->spr ? jpeg->spr->height() : jpeg->tft->height();
+    rs->clipLeft = (jpeg->x < 0) ? ((-jpeg->x < (int32_t)w) ? -jpeg->x : w) : 0;
+    rs->clipRight = (jpeg->x + (int32_t)w > dispWidth) ? dispWidth - jpeg->x : w;
+    if(rs->clipRight < rs->clipLeft) rs->clipRight = rs->clipLeft;
+    rs->clipBottom = dispHeight - jpeg->y;
+
+    for(uint16_t x = 0; x < srcWidth; x++) rs->colCount[jpgResampleMap(x, rs->stepX, w)]++;
+    for(uint16_t y = 0; y < srcHeight; y++) rs->rowCount[jpgResampleMap(y, rs->stepY, h)]++;
+
+    // Sums are 16 bit, so at most 257 source pixels may land in one output pixel
+    uint8_t colMax = 0, rowMax = 0;
+    for(uint16_t x = 0; x < w; x++) if(rs->colCount[x] > colMax) colMax = rs->colCount[x];
+    for(uint16_t y = 0; y < h; y++) if(rs->rowCount[y] > rowMax) rowMax = rs->rowCount[y];
+    if(colMax * rowMax > 257){
+        free(rs->sum);
+        free(rs->colCount);
+        free(rs->line);
+        log_e("Box too small for the image");
+        return false;
+    }
+
+    return true;
 }
-/***************************************************************************************
-** Function name:           drawStringRTLAr
-** Description:             Draw the string Arabic RTL at defined coordinates
-***************************************************************************************/
-// Must call with variables, &x and &y
-void TFT_eFEX::drawStringRTLAr(const char *string, int32_t *x, int32_t *y)
-{
-  int32_t poX = *x;
-  int32_t poY = *y;
 
-  int16_t len = strlen(string);
+// Average and send the completed output rows up to (not including) end
+static void jpgResampleFlush(jpg_file_decoder_t * jpeg, uint16_t end){
+    jpg_resample_t * rs = jpeg->resample;
 
-  if (_tft->fontLoaded)
-  {
-    uint8_t datum = _tft->getTextDatum();
-    int16_t cx = _tft->getCursorX();
-    int16_t cy = _tft->getCursorY();
-    _tft->setTextDatum(TL_DATUM);
-    uint16_t n = 0;
-    uint16_t PrevChar = '\0';
-    uint16_t NextChar = '\0';
-    while (n < len)
-    {
-      uint16_t uniCode = _tft->decodeUTF8((uint8_t*)string, &n, len - n);
-      uint16_t nPefore = n;
-      if (n < len)
-      {
-        NextChar = _tft->decodeUTF8((uint8_t *)string, &nPefore, len - nPefore);
-      }else{
-        NextChar = '\0';
-      }
-      if (uniCode >= 0x0621 && uniCode <= 0x06d5) //Replace Char
-      {
-        uint8_t loc = Location(uniCode,NextChar, PrevChar);
-        PrevChar = uniCode;
-        // Serial.print("X");
-        // Serial.print(uniCode, HEX);
-        // Serial.print("L");
-        // Serial.print((int)loc, HEX);
-        // Serial.print("G");
-        // Serial.print(uniCode - 0x0622, HEX);
-        for(int i=0;i<CODECOUNT;i++){
-          if (codes[i][0] == uniCode)
-          {
-            if (codes[i][loc])
-            uniCode =codes[i][loc];
-          }
+    uint16_t left = rs->clipLeft;
+    uint16_t dw = rs->clipRight - left;
+    int16_t dx = jpeg->x + left;
+
+    while(rs->nextRow < end){
+        uint16_t row = rs->nextRow++;
+        uint16_t *sum = rs->sum + (row % rs->rows) * rs->width * 3;
+        uint8_t rowCount = rs->rowCount[row];
+        int16_t dy = jpeg->y + row;
+
+        // Rows off the Sprite or screen are only cleared
+        if(dy < 0 || (int32_t)row >= rs->clipBottom || !dw){
+            memset(sum, 0, rs->width * 3 * sizeof(uint16_t));
+            continue;
         }
-        //search for letter here
-        // Serial.print("N");
-        // Serial.println(uniCode, HEX);
-        // delay(5);
-        // yield();
-      }else{
-        PrevChar = uniCode;
-      }
-      uint16_t gNum = 0;
-      bool found = _tft->getUnicodeIndex(uniCode, &gNum);
 
-      if (uniCode == 0x20)
-      {
-        poX -= _tft->gFont.spaceWidth;
-      }
-      else if (uniCode == '\n')
-      {
-        poX = _tft->width() - 1;
-        poY += _tft->gFont.yAdvance;
-      }else if (found){
-        poX -= (_tft->gWidth[gNum] + _tft->gdX[gNum]);
+        for(uint16_t x = 0; x < rs->width; x++){
+            uint16_t n = rs->colCount[x] * rowCount;
+            for(uint8_t c = 0; c < 3; c++){
+                rs->line[3 * x + c] = (sum[c] + (n >> 1)) / n;
+                sum[c] = 0;
+            }
+            sum += 3;
+        }
 
-        if (poX < 0)
-        {
-          poX = _tft->width() - (_tft->gWidth[gNum] + _tft->gdX[gNum]);
-          poY += _tft->gFont.yAdvance;
-          if (poY >= _tft->height())
-            poY = 0;
+        uint8_t *line = rs->line + 3 * left;
+        if(jpeg->spr){
+            jpgSpriteRows(jpeg, line, rs->width, dx, dy, dw, 1);
+        } else {
+            if(jpeg->dither) rgb565DitherRow(line, rs->pix, dw, dx, dy, false, true);
+            else jpgConvert(line, rs->pix, dw);
+            if(!jpeg->inTransaction) jpeg->tft->startWrite();
+            jpeg->tft->setAddrWindow(dx, dy, dw, 1);
+            jpgPush(jpeg, rs->pix, dw);
+            if(!jpeg->inTransaction) jpeg->tft->endWrite();
         }
+    }
+}
 
-        _tft->setCursor(poX, poY);
-        _tft->drawGlyph(uniCode);
-      }
+// Output function for resizing, adds each decoded pixel to the sum of the output
+// pixel it falls in. Rows are sent once the decoder moves on to the band below
+static uint32_t jpgWriteResample(JDEC *decoder, void *bitmap, JRECT *rect){
+    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
+    jpg_resample_t * rs = jpeg->resample;
+    uint32_t start = 0, pushTime = 0;
+    if(jpeg->stats){
+        start = micros();
+        pushTime = jpeg->stats->pushTime;
+        jpeg->stats->blocks++;
     }
+    uint8_t *data = (uint8_t *)bitmap;
 
-    _tft->setTextDatum(datum);
-    _tft->setCursor(cx, cy);
+    if(rect->top != rs->bandTop){
+        uint16_t top = jpgResampleMap(rect->top, rs->stepY, rs->height);
+        jpgResampleFlush(jpeg, top);
+        rs->bandTop = rect->top;
+        // Stop the decoder once below the Sprite or screen, or if no column is visible
+        if((int32_t)top >= rs->clipBottom || rs->clipLeft == rs->clipRight){
+            return 0;
+        }
+    }
 
-    *x = poX;
-    *y = poY;
-  }
-}
+    for(uint16_t y = rect->top; y <= rect->bottom; y++){
+        uint16_t *sum = rs->sum + (jpgResampleMap(y, rs->stepY, rs->height) % rs->rows) * rs->width * 3;
+        for(uint16_t x = rect->left; x <= rect->right; x++){
+            uint16_t *s = sum + 3 * jpgResampleMap(x, rs->stepX, rs->width);
+            s[0] += data[0];
+            s[1] += data[1];
+            s[2] += data[2];
+            data += 3;
+        }
+    }
 
-/***************************************************************************************
-** Function name:           setCursorLTR
-** Description:             Draw the string LTR and update cursor coordinates
-***************************************************************************************/
-void TFT_eFEX::drawStringLTR(const String& string)
-{
-  int16_t len = string.length() + 2;
-  char sbuffer[len];
-  string.toCharArray(sbuffer, len);
-  drawStringLTR(sbuffer, &rtl_cursorX, &rtl_cursorY);
+    jpgConvertTime(jpeg, start, pushTime);
+    return 1;
 }
 
+static bool jpgDecode(jpg_file_decoder_t * jpeg, uint32_t(* reader)(JDEC*,uint8_t *, uint32_t)){
+    JDEC decoder;
 
-/***************************************************************************************
-** Function name:           drawStringLTR
-** Description:             Draw the string LTR at defined coordinates
-***************************************************************************************/
-void TFT_eFEX::drawStringLTR(const char *string, int32_t *x, int32_t *y)
-{
-  int32_t poX = *x;
-  int32_t poY = *y;
+    if(!jpeg->work){
+        log_e("No jpeg work buffer");
+        jpeg->result = JDR_MEM1;
+        return false;
+    }
 
-  int16_t len = strlen(string);
+    // Time in the decoder is the total less the time spent in the input and output functions
+    uint32_t start = 0, callbackTime = 0;
+    if(jpeg->stats){
+        start = micros();
+        callbackTime = jpeg->stats->readTime + jpeg->stats->convertTime + jpeg->stats->pushTime;
+    }
 
-  uint16_t pointCodes[len];
-  uint16_t index = 0;
+    JRESULT jres = jd_prepare(&decoder, reader, jpeg->work, jpeg->workSize, jpeg);
+    jpeg->result = jres;
+    if(jres == JDR_FMT3){
+        // Grayscale (and some sampling factors), drawJpg() and drawJpgFile() use the bundled decoder
+        log_d("jd_prepare: %s", jd_errors[jres]);
+        return false;
+    }
+    if(jres != JDR_OK){
+        log_e("jd_prepare failed! %s", jd_errors[jres]);
+        return false;
+    }
 
-  if (_tft->fontLoaded)
-  {
-    uint8_t datum = _tft->getTextDatum();
-    int16_t cx = _tft->getCursorX();
-    int16_t cy = _tft->getCursorY();
-    _tft->setTextDatum(TL_DATUM);
-    uint16_t n = 0;
+    if(jpeg->resample && !jpgResampleSetup(jpeg, &decoder)){
+        return false;
+    }
 
-    while (n < len)
-    {
-      uint16_t uniCode = _tft->decodeUTF8((uint8_t*)string, &n, len - n);
-      pointCodes[index++] = uniCode;
+    uint16_t jpgWidth = decoder.width / (1 << (uint8_t)(jpeg->scale));
+    uint16_t jpgHeight = decoder.height / (1 << (uint8_t)(jpeg->scale));
+
+    if(jpeg->offX >= jpgWidth || jpeg->offY >= jpgHeight){
+        log_e("Offset Outside of JPEG size");
+        return false;
     }
 
-    while (index--)
-    {
-      uint16_t gNum = 0;
-      bool found = _tft->getUnicodeIndex(pointCodes[index], &gNum);
+    size_t jpgMaxWidth = jpgWidth - jpeg->offX;
+    size_t jpgMaxHeight = jpgHeight - jpeg->offY;
 
-      if (pointCodes[index] == 0x20)
-      {
-        poX -= _tft->gFont.spaceWidth;
-      }
-      else if (pointCodes[index] == '\n')
-      {
-        poX = _tft->width() - 1;
-        poY += _tft->gFont.yAdvance;
-      }
+    // Clip to the Sprite or screen by moving the crop window, so hidden blocks are
+    // never pushed. An image wholly off the Sprite or screen is not decoded
+    if(!jpeg->resample){
+        int16_t dispWidth  = jpeg->spr ? jpeg->spr->width()  : jpeg->tft->width();
+        int16_t dispHeight = jpeg->spr ? jpeg->spr->height() : jpeg->tft->height();
+
+        if(jpeg->x < 0){
+            uint16_t clip = -jpeg->x;
+            if(clip >= jpgMaxWidth || clip >= jpeg->maxWidth) return true;
+            jpeg->offX += clip;
+            jpeg->maxWidth -= clip;
+            jpgMaxWidth -= clip;
+            jpeg->x = 0;
+        }
+        if(jpeg->y < 0){
+            uint16_t clip = -jpeg->y;
+            if(clip >= jpgMaxHeight || clip >= jpeg->maxHeight) return true;
+            jpeg->offY += clip;
+            jpeg->maxHeight -= clip;
+            jpgMaxHeight -= clip;
+            jpeg->y = 0;
+        }
+        if(jpeg->x >= dispWidth || jpeg->y >= dispHeight) return true;
 
-      if (found)
-      {
-        poX -= ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
+        if(jpeg->maxWidth > dispWidth - jpeg->x) jpeg->maxWidth = dispWidth - jpeg->x;
+        if(jpeg->maxHeight > dispHeight - jpeg->y) jpeg->maxHeight = dispHeight - jpeg->y;
+    }
 
-        if (poX < 0)
-        {
-          poX = _tft->width() - ( _tft->gWidth[gNum] + _tft->gdX[gNum] );
-          poY += _tft->gFont.yAdvance;
-          if (poY >= _tft->height()) poY = 0;
+    jpeg->outWidth = (jpgMaxWidth > jpeg->maxWidth)?jpeg->maxWidth:jpgMaxWidth;
+    jpeg->outHeight = (jpgMaxHeight > jpeg->maxHeight)?jpeg->maxHeight:jpgMaxHeight;
+
+    jpeg->dmaBuf[0] = nullptr;
+    jpeg->dmaBuf[1] = nullptr;
+    jpeg->dmaIndex = 0;
+
+#ifdef JPG_USE_DMA
+    // DMA transfers send pixels as they are, so are only used if the TFT is not set to swap bytes
+    if(!jpeg->previewShift && !jpeg->spr && !jpeg->resample && !jpeg->tft->getSwapBytes()){
+        // pushImageDMA() does nothing until tft.initDMA() has been called, so use
+        // blocking pushes rather than leave the screen blank
+        static bool dmaWarned = false;
+        if(!jpeg->tft->DMA_Enabled){
+            if(!dmaWarned) log_e("JPG_USE_DMA is set but tft.initDMA() has not been called");
+            dmaWarned = true;
         }
+        else jpeg->dmaBuf[0] = (uint16_t *)heap_caps_malloc(2 * JPG_BLOCK_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA);
+        if(jpeg->dmaBuf[0]){
+            jpeg->dmaBuf[1] = jpeg->dmaBuf[0] + JPG_BLOCK_PIXELS;
+            // The transaction is held for the whole image while DMA transfers are queued
+            if(!jpeg->inTransaction) jpeg->tft->startWrite();
+        }
+    }
+#endif
 
-        _tft->setCursor(poX, poY);
-        _tft->drawGlyph(pointCodes[index]);
-      }
+    if(jpeg->resample){
+        jres = jd_decomp(&decoder, jpgWriteResample, (uint8_t)jpeg->scale);
+        if(jres == JDR_OK) jpgResampleFlush(jpeg, jpeg->resample->height);
+        free(jpeg->resample->sum);
+        free(jpeg->resample->colCount);
+        free(jpeg->resample->line);
+    } else if(jpeg->previewShift){
+        jres = jd_decomp(&decoder, jpgWritePreview, (uint8_t)jpeg->scale + jpeg->previewShift);
+    } else {
+        jres = jd_decomp(&decoder, jpgWrite, (uint8_t)jpeg->scale);
     }
 
-    _tft->setTextDatum(datum);
-    _tft->setCursor(cx, cy);
+    // The output functions only interrupt the decoder once past the crop window
+    if(jres == JDR_INTR){
+        jres = JDR_OK;
+    }
 
-    *x = poX;
-    *y = poY;
-  }
-}
-#endif // smooth font enabled
+#ifdef JPG_USE_DMA
+    if(jpeg->dmaBuf[0]){
+        jpeg->tft->dmaWait();
+        if(!jpeg->inTransaction) jpeg->tft->endWrite();
+        free(jpeg->dmaBuf[0]);
+    }
+#endif
+    if(jpeg->stats){
+        callbackTime = jpeg->stats->readTime + jpeg->stats->convertTime + jpeg->stats->pushTime - callbackTime;
+        jpeg->stats->decodeTime += (micros() - start) - callbackTime;
+        uint32_t poolUsed = jpeg->workSize - decoder.sz_pool + jpeg->readSize;
+        if(poolUsed > jpeg->stats->peakBuffer) jpeg->stats->peakBuffer = poolUsed;
+    }
 
-//====================================================================================
-//                           Screen server call with no filename
-//====================================================================================
-// Start a screen dump server (serial or network) - no filename specified
-bool TFT_eFEX::screenServer(void)
-{
-  // With no filename the screenshot will be saved with a default name e.g. tft_screen_#.xxx
-  // where # is a number 0-9 and xxx is a file type specified below
-  return screenServer(DEFAULT_FILENAME);
+    if(jres != JDR_OK){
+        log_e("jd_decomp failed! %s", jd_errors[jres]);
+        return false;
+    }
+
+    return true;
 }
 
-//====================================================================================
-//                           Screen server call with filename
-//====================================================================================
-// Start a screen dump server (serial or network) - filename specified
-bool TFT_eFEX::screenServer(String filename)
-{
-  delay(0); // Equivalent to yield() for ESP8266;
+#endif // ESP32 only
 
-  boolean result = serialScreenServer(filename); // Screenshot serial port server
-  //boolean result = wifiScreenServer(filename);   // Screenshot WiFi UDP port server (WIP)
 
-  delay(0); // Equivalent to yield()
+/***************************************************************************************
+** Function name:           drawJpegThumb
+** Description:             draw a 1/8 scale thumbnail of a jpeg stored in SPIFFS
+***************************************************************************************/
+bool TFT_eFEX::drawJpegThumb(String filename, int16_t xpos, int16_t ypos) {
+  return jpegThumb(filename, nullptr, 0, xpos, ypos, 0, 0, false);
+}
 
-  //Serial.println();
-  //if (result) Serial.println(F("Screen dump passed :-)"));
-  //else        Serial.println(F("Screen dump failed :-("));
 
-  return result;
+/***************************************************************************************
+** Function name:           drawJpegThumb
+** Description:             draw a 1/8 scale thumbnail of a jpeg stored in FLASH
+***************************************************************************************/
+bool TFT_eFEX::drawJpegThumb(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos) {
+  return jpegThumb("", arrayname, array_size, xpos, ypos, 0, 0, false);
 }
 
-//====================================================================================
-//                Serial server function that sends the data to the client
-//====================================================================================
-bool TFT_eFEX::serialScreenServer(String filename)
-{
-  // Precautionary receive buffer garbage flush for 50ms
-  uint32_t clearTime = millis() + 50;
-  while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
 
-  boolean wait = true;
-  uint32_t lastCmdTime = millis();     // Initialise start of command time-out
+/***************************************************************************************
+** Function name:           drawContactSheet
+** Description:             draw a grid of jpeg thumbnails from SPIFFS
+***************************************************************************************/
+// e.g. const char *files[] = {"/Baboon.jpg", "/Tiger.jpg", "/EagleEye.jpg"};
+//      jpeg_grid_t grid = {0, 0, 40, 40, 6, 2}; // x, y, cellW, cellH, cols, gap
+//      fex.drawContactSheet(files, 3, grid);
+uint16_t TFT_eFEX::drawContactSheet(const char *paths[], uint16_t n, jpeg_grid_t grid) {
 
-  // Wait for the starting flag with a start time-out
-  while (wait)
+  if (grid.cols == 0) grid.cols = 1;
+
+  uint16_t drawn = 0;
+
+  // Hold the SPI transaction for the whole sheet rather than one per image block
+  _tft->startWrite();
+
+  for (uint16_t i = 0; i < n; i++)
   {
-    delay(0); // Equivalent to yield() for ESP8266;
-    // Check serial buffer
-    if (Serial.available() > 0) {
-      // Read the command byte
-      uint8_t cmd = Serial.read();
-      // If it is 'S' (start command) then clear the serial buffer for 100ms and stop waiting
-      if ( cmd == 'S' ) {
-        // Precautionary receive buffer garbage flush for 50ms
-        clearTime = millis() + 50;
-        while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
+    int32_t x = grid.x + (i % grid.cols) * (grid.cellW + grid.gap);
+    int32_t y = grid.y + (i / grid.cols) * (grid.cellH + grid.gap);
 
-        wait = false;           // No need to wait anymore
-        lastCmdTime = millis(); // Set last received command time
+    if (y >= _tft->height()) break; // Remaining cells are below the screen
 
-        // Send screen size etc using a simple header with delimiters for client checks
-        sendParameters(filename);
-      }
-    }
-    else
-    {
-      // Check for time-out
-      if ( millis() > lastCmdTime + START_TIMEOUT) return false;
-    }
+    if (jpegThumb(paths[i], nullptr, 0, x, y, grid.cellW, grid.cellH, true)) drawn++;
   }
 
-  uint8_t color[3 * NPIXELS]; // RGB and 565 format color buffer for N pixels
+  _tft->endWrite();
 
-  // Send all the pixels on the whole screen
-  for ( uint32_t y = 0; y < _tft->height(); y++)
+  return drawn;
+}
+
+
+/***************************************************************************************
+** Function name:           jpegThumb
+** Description:             render a 1/8 scale jpeg thumbnail cropped to maxWidth x maxHeight
+***************************************************************************************/
+// If arrayname is nullptr the image is read from the SPIFFS file filename
+#ifdef ESP32
+bool TFT_eFEX::jpegThumb(String filename, const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos,
+                         uint16_t maxWidth, uint16_t maxHeight, bool inTransaction) {
+
+  jpg_file_decoder_t jpeg;
+  fs::File file;
+
+  if (arrayname == nullptr)
   {
-    // Increment x by NPIXELS as we send NPIXELS for every byte received
-    for ( uint32_t x = 0; x < _tft->width(); x += NPIXELS)
+    // Note: ESP32 passes "open" test even if file does not exist
+    if ( !SPIFFS.exists(filename) )
     {
-      delay(0); // Equivalent to yield() for ESP8266;
+      Serial.println(F(" Jpeg file not found")); // Can comment out if not needed
+      return false;
+    }
+    file = SPIFFS.open(filename, "r");
+    if (!file) return false;
+    jpeg.src = &file;
+    jpeg.len = file.size();
+  }
+  else
+  {
+    jpeg.src = arrayname;
+    jpeg.len = array_size;
+  }
 
-      // Wait here for serial data to arrive or a time-out elapses
-      while ( Serial.available() == 0 )
-      {
-        if ( millis() > lastCmdTime + PIXEL_TIMEOUT) return false;
-        delay(0); // Equivalent to yield() for ESP8266;
-      }
+  jpeg.index = 0;
+  jpeg.x = xpos;
+  jpeg.y = ypos;
+  jpeg.maxWidth = maxWidth ? maxWidth : 0xFFFF; // Also clipped to the screen by jpgDecode()
+  jpeg.maxHeight = maxHeight ? maxHeight : 0xFFFF;
+  jpeg.offX = 0;
+  jpeg.offY = 0;
+  // At 1/8 scale tjpgd outputs the DC coefficient of each 8x8 block and skips the IDCT
+  jpeg.scale = JPEG_DIV_8;
+  jpeg.tft = _tft;
+  jpeg.inTransaction = inTransaction;
+  jpeg.previewShift = 0;
+  jpeg.spr = nullptr;
+  jpeg.stats = nullptr;
+  jpeg.work = jpgWorkBuffer();
+  jpeg.workSize = jpg_work_size;
+  jpgReadBuffer(&jpeg, (arrayname == nullptr) ? jpg_read_size : 0);
+  jpeg.resample = nullptr;
+  jpeg.dither = color_dither;
+
+  bool result = jpgDecode(&jpeg, (arrayname == nullptr) ? jpgReadFile : jpgRead);
+
+  free(jpeg.readBuf);
+  if (arrayname == nullptr) file.close();
 
-      // Serial data must be available to get here, read 1 byte and
-      // respond with N pixels, i.e. N x 3 RGB bytes or N x 2 565 format bytes
-      if ( Serial.read() == 'X' ) {
-        // X command byte means abort, so clear the buffer and return
-        clearTime = millis() + 50;
-        while ( millis() < clearTime && Serial.read() >= 0) delay(0); // Equivalent to yield() for ESP8266;
-        return false;
-      }
-      // Save arrival time of the read command (for later time-out check)
-      lastCmdTime = millis();
+  return result;
+}
 
-#if defined BITS_PER_PIXEL && BITS_PER_PIXEL >= 24 && NPIXELS > 1
-      // Fetch N RGB pixels from x,y and put in buffer
-      _tft->readRectRGB(x, y, NPIXELS, 1, color);
-      // Send buffer to client
-      Serial.write(color, 3 * NPIXELS); // Write all pixels in the buffer
-#else
-      // Fetch N 565 format pixels from x,y and put in buffer
-      if (NPIXELS > 1) _tft->readRect(x, y, NPIXELS, 1, (uint16_t *)color);
-      else
-      {
-        uint16_t c = _tft->readPixel(x, y);
-        color[0] = c>>8;
-        color[1] = c & 0xFF;  // Swap bytes
-      }
-      // Send buffer to client
-      Serial.write(color, 2 * NPIXELS); // Write all pixels in the buffer
-#endif
+#else // Bundled decoder
+
+bool TFT_eFEX::jpegThumb(String filename, const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos,
+                         uint16_t maxWidth, uint16_t maxHeight, bool inTransaction) {
+
+  bool decoded;
+
+  // At 1/8 scale the bundled decoder outputs the DC coefficient of each 8x8 block and skips the IDCT
+  if (arrayname == nullptr)
+  {
+    if ( !SPIFFS.exists(filename) )
+    {
+      Serial.println(F(" Jpeg file not found")); // Can comment out if not needed
+      return false;
     }
+    fs::File file = SPIFFS.open(filename, "r");
+    if (!file) return false;
+    decoded = jpegRender(&file, nullptr, file.size(), xpos, ypos, nullptr, nullptr, 3, maxWidth, maxHeight, inTransaction);
+    file.close();
   }
+  else decoded = jpegRender(nullptr, arrayname, array_size, xpos, ypos, nullptr, nullptr, 3, maxWidth, maxHeight, inTransaction);
 
-  Serial.flush(); // Make sure all pixel bytes have been despatched
+  if (!decoded) Serial.println("Jpeg file format not supported!");
 
-  return true;
+  return decoded;
 }
+#endif
 
-//====================================================================================
-//    Send screen size etc using a simple header with delimiters for client checks
-//====================================================================================
-void TFT_eFEX::sendParameters(String filename)
-{
-  Serial.write('W'); // Width
-  Serial.write(_tft->width()  >> 8);
-  Serial.write(_tft->width()  & 0xFF);
 
-  Serial.write('H'); // Height
-  Serial.write(_tft->height() >> 8);
-  Serial.write(_tft->height() & 0xFF);
+/***************************************************************************************
+** Function name:           drawJpegThumbnail
+** Description:             draw the EXIF thumbnail of a jpeg stored in SPIFFS
+***************************************************************************************/
+bool TFT_eFEX::drawJpegThumbnail(String filename, int16_t xpos, int16_t ypos, uint8_t *orientation, TFT_eSprite *_spr) {
 
-  Serial.write('Y'); // Bits per pixel (16 or 24)
-  if (NPIXELS > 1) Serial.write(BITS_PER_PIXEL);
-  else Serial.write(16); // readPixel() only provides 16 bit values
+  if (orientation) *orientation = 0;
 
-  Serial.write('?'); // Filename next
-  Serial.print(filename);
+  // Note: ESP32 passes "open" test even if file does not exist, whereas ESP8266 returns NULL
+  if ( !SPIFFS.exists(filename) )
+  {
+    Serial.println(F(" Jpeg file not found")); // Can comment out if not needed
+    return false;
+  }
 
-  Serial.write('.'); // End of filename marker
+  fs::File file = SPIFFS.open(filename, "r");
+  if (!file) return false;
 
-  Serial.write(FILE_EXT); // Filename extension identifier
+  bool decoded = jpegThumbnail(&file, nullptr, file.size(), xpos, ypos, orientation, _spr);
 
-  Serial.write(*FILE_TYPE); // First character defines file type j,b,p,t
+  file.close();
+
+  return decoded;
 }
 
 
-/**************************************************************************/
-//
-//    Bodmer added native JPEG decoder functions from ESP32 rom utility
-//    Source: https://github.com/espressif/WROVER_KIT_LCD
-//
-/**************************************************************************/
-#ifdef ESP32
+/***************************************************************************************
+** Function name:           drawJpegThumbnail
+** Description:             draw the EXIF thumbnail of a jpeg stored in FLASH
+***************************************************************************************/
+bool TFT_eFEX::drawJpegThumbnail(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, uint8_t *orientation, TFT_eSprite *_spr) {
 
-// Include these in header file
-// #include "rom/tjpgd.h"
-// #include "FS.h"
+  if (orientation) *orientation = 0;
 
-#define jpgColor(c) (((uint16_t)(((uint8_t*)(c))[0] & 0xF8) << 8) | \
-                     ((uint16_t)(((uint8_t*)(c))[1] & 0xFC) << 3) | \
-                     ((((uint8_t*)(c))[2] & 0xF8) >> 3))
+  return jpegThumbnail(nullptr, arrayname, array_size, xpos, ypos, orientation, _spr);
+}
 
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_ERROR
-const char * jd_errors[] = {
-    "Succeeded",
-    "Interrupted by output function",
-    "Device error or wrong termination of input stream",
-    "Insufficient memory pool for the image",
-    "Insufficient stream input buffer",
-    "Parameter error",
-    "Data format error",
-    "Right format but not supported",
-    "Not supported JPEG standard"
-};
-#endif
 
-// Struct to pass parameters to jpeg decoder
-typedef struct {
-        uint16_t x;
-        uint16_t y;
-        uint16_t maxWidth;
-        uint16_t maxHeight;
-        uint16_t offX;
-        uint16_t offY;
-        jpeg_div_t scale;
-        const void * src;
-        size_t len;
-        size_t index;
-        TFT_eSPI * tft;
-        uint16_t outWidth;
-        uint16_t outHeight;
-} jpg_file_decoder_t;
+/***************************************************************************************
+** Function name:           jpegThumbnail
+** Description:             draw the EXIF thumbnail, or a 1/8 scale thumbnail if there is none
+***************************************************************************************/
+// Only the thumbnail bytes are read, so the time taken does not depend on the image size
+bool TFT_eFEX::jpegThumbnail(fs::File *file, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos, uint8_t *orientation, TFT_eSprite *_spr) {
 
-/**************************************************************************/
-//
-//    JPEG decoder support function prototypes
-//
-/**************************************************************************/
-static uint32_t jpgReadFile(JDEC *decoder, uint8_t *buf, uint32_t len);
-static uint32_t jpgRead(JDEC *decoder, uint8_t *buf, uint32_t len);
-static uint32_t jpgWrite(JDEC *decoder, void *bitmap, JRECT *rect);
-static bool     jpgDecode(jpg_file_decoder_t * jpeg, uint32_t(* reader)(JDEC*,uint8_t *, uint32_t));
+  uint32_t offset, length;
 
+  if (exifThumbnail(file, data, len, &offset, &length, orientation))
+  {
+    bool decoded;
+    if (file)
+    {
+      file->seek(offset);
+      decoded = jpegRender(file, nullptr, length, xpos, ypos, _spr, nullptr);
+    }
+    else decoded = jpegRender(nullptr, data + offset, length, xpos, ypos, _spr, nullptr);
 
-/**************************************************************************/
-/*!
-    @brief  Decode an array stored FLASH in memory (ESP32 only)
-    @param    Array name
-    @param    Size of array, use sizeof(array_name)
-    @param    Display x coord to draw at
-    @param    Display y coord to draw at
-    @param    Optional: Unscaled jpeg maximum width in pixels
-    @param    Optional: Unscaled jpeg maximum height in pixels
-    @param    Optional: Unscaled jpeg start x coordinate offset in jpeg
-    @param    Optional: Unscaled jpeg start y coordinate offset in jpeg
-    @param    Optional: Scale factor 0-4 (type jpeg_div_t)
-    @return   true if decoded, else false
-*/
-/**************************************************************************/
-// e.g tft.drawJpg(EagleEye, sizeof(EagleEye), 0, 10);
-// Where EagleEye is an array of bytes in PROGMEM:
-// const uint8_t EagleEye[] PROGMEM = {...};
-bool TFT_eFEX::drawJpg(const uint8_t * jpg_data, size_t jpg_len, uint16_t x, uint16_t y, uint16_t maxWidth, uint16_t maxHeight, uint16_t offX, uint16_t offY, jpeg_div_t scale){
+    if (decoded) return true;
+  }
+
+  // No usable thumbnail so decode only the DC coefficients of the image
+  if (file) file->seek(0);
 
-    maxWidth = maxWidth>>(uint8_t)scale;
-    maxHeight = maxHeight>>(uint8_t)scale;
+  bool decoded = jpegRender(file, data, len, xpos, ypos, _spr, nullptr, 3);
+
+  if (!decoded) Serial.println("Jpeg file format not supported!");
+
+  return decoded;
+}
+
+
+// Read n bytes at pos in a file or array, false if past the end
+static bool exifRead(fs::File *file, const uint8_t *data, uint32_t len, uint32_t pos, uint8_t *buf, uint16_t n) {
+
+  if ((pos > len) || (n > len - pos)) return false;
+  if (file)
+  {
+    file->seek(pos);
+    return file->read(buf, n) == n;
+  }
+  memcpy_P(buf, data + pos, n);
+  return true;
+}
 
-    if((x + maxWidth) > _tft->width() || (y + maxHeight) > _tft->height()){
-        log_e("Bad dimensions given");
-        return false;
-    }
+/***************************************************************************************
+** Function name:           exifThumbnail
+** Description:             find the jpeg thumbnail and the orientation in the EXIF data
+***************************************************************************************/
+// The APP1 segment holds a TIFF file: a byte order mark ("II" Intel or "MM" Motorola)
+// then IFD0 (the main image tags, including Orientation 0x0112) which links to IFD1
+// (the thumbnail, JPEGInterchangeFormat 0x0201 and JPEGInterchangeFormatLength 0x0202).
+// Offsets in the TIFF data are from the byte order mark. Returns true if there is a
+// thumbnail, offset and length are then set to where it is in the file or array
+bool TFT_eFEX::exifThumbnail(fs::File *file, const uint8_t *data, uint32_t len, uint32_t *offset, uint32_t *length, uint8_t *orientation) {
 
-    jpg_file_decoder_t jpeg;
+  uint8_t  buf[12];
+  uint32_t pos = 2;
 
-    if(!maxWidth){
-        maxWidth = _tft->width() - x;
-    }
-    if(!maxHeight){
-        maxHeight = _tft->height() - y;
-    }
+  if (!exifRead(file, data, len, 0, buf, 2) || (buf[0] != 0xFF) || (buf[1] != 0xD8)) return false;
 
-    jpeg.src = jpg_data;
-    jpeg.len = jpg_len;
-    jpeg.index = 0;
-    jpeg.x = x;
-    jpeg.y = y;
-    jpeg.maxWidth = maxWidth;
-    jpeg.maxHeight = maxHeight;
-    jpeg.offX = offX>>(uint8_t)scale;
-    jpeg.offY = offY>>(uint8_t)scale;
-    jpeg.scale = scale;
-    jpeg.tft = this;
+  // Find the APP1 "Exif" segment, it comes before the frame header
+  while (true)
+  {
+    if (!exifRead(file, data, len, pos, buf, 10) || (buf[0] != 0xFF)) return false;
+    uint8_t  marker = buf[1];
+    uint16_t size = (buf[2] << 8) | buf[3];
+    if ((marker == 0xDA) || ((marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xCC))) return false;
+    if ((marker == 0xE1) && !memcmp(buf + 4, "Exif\0\0", 6)) break;
+    pos += 2 + size;
+  }
 
-    return jpgDecode(&jpeg, jpgRead);
-}
+  uint32_t segEnd = pos + 2 + ((buf[2] << 8) | buf[3]);
+  uint32_t tiff = pos + 10; // Byte order mark
+  if (segEnd > len) segEnd = len;
+  if ((segEnd < tiff) || (segEnd - tiff < 8)) return false;
 
-/**************************************************************************/
-/*!
-    @brief  Decode an array stored as a file (ESP32 only)
-    @param    Filing system, e.g. SPIFFS
-    @param    File name, precede with / for SPIFFS
-    @param    Display x coord to draw at
-    @param    Display y coord to draw at
-    @param    Optional: Unscaled jpeg maximum width in pixels
-    @param    Optional: Unscaled jpeg maximum height in pixels
-    @param    Optional: Unscaled jpeg start x coordinate offset in jpeg
-    @param    Optional: Unscaled jpeg start y coordinate offset in jpeg
-    @param    Optional: Scale factor 0-4 (type jpeg_div_t)
-    @return   true if decoded, else false
-*/
-/**************************************************************************/
-// e.g. tft.drawJpgFile(SPIFFS, "/EagleEye.jpg", 0, 10);
-bool TFT_eFEX::drawJpgFile(fs::FS &fs, const char * path, uint16_t x, uint16_t y, uint16_t maxWidth, uint16_t maxHeight, uint16_t offX, uint16_t offY, jpeg_div_t scale){
+  // Offsets are checked against the bytes left in the segment (segEnd - tiff and less),
+  // adding them to tiff first could wrap past 2^32 and pass the check
 
-    maxWidth = maxWidth>>(uint8_t)scale;
-    maxHeight = maxHeight>>(uint8_t)scale;
+  if (!exifRead(file, data, len, tiff, buf, 8)) return false;
+  bool intel = (buf[0] == 'I');
+  if ((buf[0] != buf[1]) || (!intel && (buf[0] != 'M'))) return false;
 
-    if((x + maxWidth) > _tft->width() || (y + maxHeight) > _tft->height()){
-        log_e("Bad dimensions given");
-        return false;
-    }
+  #define EXIF16(p) (intel ? ((p)[0] | ((p)[1] << 8)) : (((p)[0] << 8) | (p)[1]))
+  #define EXIF32(p) (intel ? ((uint32_t)EXIF16(p) | ((uint32_t)EXIF16((p) + 2) << 16)) : (((uint32_t)EXIF16(p) << 16) | EXIF16((p) + 2)))
 
-    fs::File file = fs.open(path, "r");
-    if(!file){
-        log_e("Failed to open file for reading");
-        return false;
-    }
+  uint32_t ifd = EXIF32(buf + 4);
+  uint32_t thumbOffset = 0, thumbLength = 0;
 
-    jpg_file_decoder_t jpeg;
+  // IFD0 then IFD1, each is a count, 12 byte entries then the offset of the next IFD
+  for (uint8_t n = 0; (n < 2) && ifd && (ifd <= segEnd - tiff - 2); n++)
+  {
+    if (!exifRead(file, data, len, tiff + ifd, buf, 2)) break;
+    uint16_t entries = EXIF16(buf);
+    uint32_t entry = tiff + ifd + 2;
 
-    if(!maxWidth){
-        maxWidth = _tft->width() - x;
-    }
-    if(!maxHeight){
-        maxHeight = _tft->height() - y;
+    for (uint16_t i = 0; (i < entries) && (segEnd - entry >= 12); i++, entry += 12)
+    {
+      if (!exifRead(file, data, len, entry, buf, 12)) break;
+      uint16_t tag  = EXIF16(buf);
+      uint16_t type = EXIF16(buf + 2);
+      // SHORT values are left aligned in the 4 byte value field, LONG fill it
+      uint32_t value = (type == 3) ? EXIF16(buf + 8) : EXIF32(buf + 8);
+
+      if ((n == 0) && (tag == 0x0112) && orientation && (value >= 1) && (value <= 8)) *orientation = value;
+      if ((n == 1) && (tag == 0x0201)) thumbOffset = value;
+      if ((n == 1) && (tag == 0x0202)) thumbLength = value;
     }
 
-    jpeg.src = &file;
-    jpeg.len = file.size();
-    jpeg.index = 0;
-    jpeg.x = x;
-    jpeg.y = y;
-    jpeg.maxWidth = maxWidth;
-    jpeg.maxHeight = maxHeight;
-    jpeg.offX = offX>>(uint8_t)scale;
-    jpeg.offY = offY>>(uint8_t)scale;
-    jpeg.scale = scale;
-    jpeg.tft = this;
+    if (!exifRead(file, data, len, entry, buf, 4)) break;
+    ifd = EXIF32(buf);
+  }
 
-    bool result = jpgDecode(&jpeg, jpgReadFile);
+  #undef EXIF16
+  #undef EXIF32
 
-    file.close();
-    return result;
+  if (!thumbOffset || !thumbLength) return false;
+  if ((thumbOffset > segEnd - tiff) || (thumbLength > segEnd - tiff - thumbOffset)) return false;
+
+  *offset = tiff + thumbOffset;
+  *length = thumbLength;
+  return true;
 }
 
+
 /**************************************************************************/
 //
-//    JPEG decoder support functions
+//    Motion-JPEG playback
 //
 /**************************************************************************/
-static uint32_t jpgReadFile(JDEC *decoder, uint8_t *buf, uint32_t len){
-    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
-    fs::File * file = (fs::File *)jpeg->src;
-    if(buf){
-        return file->read(buf, len);
-    } else {
-        file->seek(len, fs::SeekCur);
-    }
-    return len;
+
+// Frame index built once per clip by mjpegIndex()
+typedef struct {
+  uint32_t *offset;  // Start of each jpeg in the source
+  uint32_t *length;  // Size of each jpeg in bytes
+  uint32_t frames;
+  uint32_t capacity;
+  uint32_t maxLength;
+  float    fps;      // Frame rate from the AVI header, 0 if not known
+} mjpeg_index_t;
+
+// States used when scanning a stream of concatenated jpegs
+enum { MJ_SOI, MJ_MARKER, MJ_LEN1, MJ_LEN2, MJ_SKIP, MJ_ENTROPY };
+
+typedef struct {
+  uint8_t  state;
+  uint8_t  marker;   // Marker whose segment is being skipped
+  bool     ff;       // Previous byte was 0xFF
+  uint32_t skip;     // Segment bytes left to skip
+  uint32_t start;    // Offset of the SOI of the current frame
+} mjpeg_scan_t;
+
+/***************************************************************************************
+** Function name:           mjpegRead
+** Description:             read bytes from the clip file or array
+***************************************************************************************/
+static uint32_t mjpegRead(fs::File *file, const uint8_t *data, uint32_t len, uint32_t pos, uint8_t *buf, uint32_t n)
+{
+  if (pos >= len) return 0;
+  if (n > len - pos) n = len - pos;
+  if (file == nullptr)
+  {
+    memcpy_P(buf, data + pos, n);
+    return n;
+  }
+  file->seek(pos);
+  return file->read(buf, n);
 }
 
-static uint32_t jpgRead(JDEC *decoder, uint8_t *buf, uint32_t len){
-    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
-    if(buf){
-        memcpy(buf, (const uint8_t *)jpeg->src + jpeg->index, len);
-    }
-    jpeg->index += len;
-    return len;
+/***************************************************************************************
+** Function name:           mjpegAddFrame
+** Description:             append a frame to the index
+***************************************************************************************/
+static bool mjpegAddFrame(mjpeg_index_t *index, uint32_t offset, uint32_t length)
+{
+  if (index->frames == index->capacity)
+  {
+    uint32_t capacity = index->capacity + 64;
+    uint32_t *o = (uint32_t *)realloc(index->offset, capacity * sizeof(uint32_t));
+    if (o == nullptr) return false;
+    index->offset = o;
+    uint32_t *l = (uint32_t *)realloc(index->length, capacity * sizeof(uint32_t));
+    if (l == nullptr) return false;
+    index->length = l;
+    index->capacity = capacity;
+  }
+  index->offset[index->frames] = offset;
+  index->length[index->frames] = length;
+  index->frames++;
+  if (length > index->maxLength) index->maxLength = length;
+  return true;
 }
 
-static uint32_t jpgWrite(JDEC *decoder, void *bitmap, JRECT *rect){
-    jpg_file_decoder_t * jpeg = (jpg_file_decoder_t *)decoder->device;
-    uint16_t x = rect->left;
-    uint16_t y = rect->top;
-    uint16_t w = rect->right + 1 - x;
-    uint16_t h = rect->bottom + 1 - y;
-    uint16_t oL = 0, oR = 0;
-    uint8_t *data = (uint8_t *)bitmap;
+/***************************************************************************************
+** Function name:           mjpegScan
+** Description:             find SOI/EOI frame boundaries in concatenated jpegs
+***************************************************************************************/
+// Marker segments are skipped using their length field, so SOI/EOI markers inside
+// embedded EXIF thumbnails are not mistaken for frame boundaries
+static bool mjpegScan(mjpeg_scan_t *scan, mjpeg_index_t *index, const uint8_t *buf, uint32_t n, uint32_t pos)
+{
+  for (uint32_t i = 0; i < n; i++, pos++)
+  {
+    uint8_t b = buf[i];
 
-    if(rect->right < jpeg->offX){
-        return 1;
-    }
-    if(rect->left >= (jpeg->offX + jpeg->outWidth)){
-        return 1;
-    }
-    if(rect->bottom < jpeg->offY){
-        return 1;
-    }
-    if(rect->top >= (jpeg->offY + jpeg->outHeight)){
-        return 1;
-    }
-    if(rect->top < jpeg->offY){
-        uint16_t linesToSkip = jpeg->offY - rect->top;
-        data += linesToSkip * w * 3;
-        h -= linesToSkip;
-        y += linesToSkip;
-    }
-    if(rect->bottom >= (jpeg->offY + jpeg->outHeight)){
-        uint16_t linesToSkip = (rect->bottom + 1) - (jpeg->offY + jpeg->outHeight);
-        h -= linesToSkip;
-    }
-    if(rect->left < jpeg->offX){
-        oL = jpeg->offX - rect->left;
-    }
-    if(rect->right >= (jpeg->offX + jpeg->outWidth)){
-        oR = (rect->right + 1) - (jpeg->offX + jpeg->outWidth);
-    }
+    switch (scan->state)
+    {
+      case MJ_SOI:
+        if (scan->ff && b == 0xD8)
+        {
+          scan->start = pos - 1;
+          scan->state = MJ_MARKER;
+        }
+        break;
 
-    uint16_t pixBuf[32];
-    uint8_t pixIndex = 0;
-    uint16_t line;
+      case MJ_MARKER:
+        if (b == 0xFF || !scan->ff) break; // Fill bytes
+        if (b == 0xD9)
+        {
+          if (!mjpegAddFrame(index, scan->start, pos + 1 - scan->start)) return false;
+          scan->state = MJ_SOI;
+        }
+        else if ((b < 0xD0 || b > 0xD7) && b != 0x01)
+        {
+          scan->marker = b;
+          scan->state = MJ_LEN1;
+        }
+        break;
+
+      case MJ_LEN1:
+        scan->skip = b << 8;
+        scan->state = MJ_LEN2;
+        break;
+
+      case MJ_LEN2:
+        scan->skip |= b;
+        scan->skip = (scan->skip < 2) ? 0 : scan->skip - 2;
+        scan->state = MJ_SKIP;
+        if (scan->skip) break;
+        // Fall through for an empty segment
+
+      case MJ_SKIP:
+        if (scan->skip && --scan->skip) break;
+        // Entropy coded data follows a start of scan header
+        scan->state = (scan->marker == 0xDA) ? MJ_ENTROPY : MJ_MARKER;
+        b = 0;
+        break;
+
+      case MJ_ENTROPY:
+        if (!scan->ff || b == 0x00 || b == 0xFF || (b >= 0xD0 && b <= 0xD7)) break;
+        if (b == 0xD9)
+        {
+          if (!mjpegAddFrame(index, scan->start, pos + 1 - scan->start)) return false;
+          scan->state = MJ_SOI;
+        }
+        else
+        {
+          // Another marker, e.g. a further scan or table
+          scan->marker = b;
+          scan->state = MJ_LEN1;
+        }
+        break;
+    }
+    scan->ff = (b == 0xFF);
+  }
+  return true;
+}
 
-    jpeg->tft->startWrite();
-    jpeg->tft->setAddrWindow(x - jpeg->offX + jpeg->x + oL, y - jpeg->offY + jpeg->y, w - (oL + oR), h);
+/***************************************************************************************
+** Function name:           mjpegIndex
+** Description:             build the frame index of a concatenated jpeg or AVI clip
+***************************************************************************************/
+static bool mjpegIndex(fs::File *file, const uint8_t *data, uint32_t len, mjpeg_index_t *index)
+{
+  uint8_t buf[512];
+  memset(index, 0, sizeof(mjpeg_index_t));
 
-    while(h--){
-        data += 3 * oL;
-        line = w - (oL + oR);
-        while(line--){
-            pixBuf[pixIndex++] = jpgColor(data);
-            data += 3;
-            if(pixIndex == 32){
-                jpeg->tft->pushColors(pixBuf, 32);
-                pixIndex = 0;
-            }
+  if (mjpegRead(file, data, len, 0, buf, 12) == 12 && !memcmp(buf, "RIFF", 4) && !memcmp(buf + 8, "AVI ", 4))
+  {
+    // AVI-MJPEG: walk the top level chunks for the stream header and the movi list
+    uint32_t pos = 12;
+    while (mjpegRead(file, data, len, pos, buf, 12) >= 8)
+    {
+      uint32_t size = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t)buf[7] << 24);
+      if (!memcmp(buf, "LIST", 4) && !memcmp(buf + 8, "hdrl", 4))
+      {
+        // The main AVI header is the first chunk in hdrl, dwMicroSecPerFrame first
+        if (mjpegRead(file, data, len, pos + 12, buf, 12) == 12 && !memcmp(buf, "avih", 4))
+        {
+          uint32_t usPerFrame = buf[8] | (buf[9] << 8) | (buf[10] << 16) | ((uint32_t)buf[11] << 24);
+          if (usPerFrame) index->fps = 1000000.0 / usPerFrame;
         }
-        data += 3 * oR;
-    }
-    if(pixIndex){
-        jpeg->tft->pushColors(pixBuf, pixIndex);
+      }
+      else if (!memcmp(buf, "LIST", 4) && !memcmp(buf + 8, "movi", 4))
+      {
+        uint32_t end = pos + 8 + size;
+        uint32_t chunk = pos + 12;
+        while (chunk + 8 <= end && mjpegRead(file, data, len, chunk, buf, 8) == 8)
+        {
+          uint32_t csize = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t)buf[7] << 24);
+          // Video frames are ##dc (compressed) or ##db chunks
+          if (buf[2] == 'd' && (buf[3] == 'c' || buf[3] == 'b') && csize)
+          {
+            if (!mjpegAddFrame(index, chunk + 8, csize)) return false;
+          }
+          chunk += 8 + csize + (csize & 1); // Chunks are padded to an even size
+        }
+        break;
+      }
+      pos += 8 + size + (size & 1);
     }
-    jpeg->tft->endWrite();
-    return 1;
+    return index->frames > 0;
+  }
+
+  // Concatenated jpegs: scan the whole source once for the frame boundaries
+  mjpeg_scan_t scan;
+  memset(&scan, 0, sizeof(scan));
+
+  uint32_t pos = 0;
+  uint32_t n;
+  while ((n = mjpegRead(file, data, len, pos, buf, sizeof(buf))) > 0)
+  {
+    if (!mjpegScan(&scan, index, buf, n, pos)) return false;
+    pos += n;
+    delay(0); // Equivalent to yield() for ESP8266;
+  }
+  return index->frames > 0;
 }
 
-static bool jpgDecode(jpg_file_decoder_t * jpeg, uint32_t(* reader)(JDEC*,uint8_t *, uint32_t)){
-    static uint8_t work[3100];
-    JDEC decoder;
+/***************************************************************************************
+** Function name:           playMjpeg
+** Description:             play a Motion-JPEG clip stored in a file
+***************************************************************************************/
+// e.g. fex.playMjpeg(SPIFFS, "/clip.avi", 0, 0, 15, 1, &stats);
+bool TFT_eFEX::playMjpeg(fs::FS &fs, const char *path, int16_t xpos, int16_t ypos, float fps, uint16_t loops, mjpeg_stats_t *stats)
+{
+  fs::File file = fs.open(path, "r");
+  if (!file)
+  {
+    Serial.println(F(" Mjpeg file not found")); // Can comment out if not needed
+    return false;
+  }
 
-    JRESULT jres = jd_prepare(&decoder, reader, work, 3100, jpeg);
-    if(jres != JDR_OK){
-        log_e("jd_prepare failed! %s", jd_errors[jres]);
-        return false;
-    }
+  bool result = mjpegPlay(&file, nullptr, file.size(), xpos, ypos, fps, loops, stats);
 
-    uint16_t jpgWidth = decoder.width / (1 << (uint8_t)(jpeg->scale));
-    uint16_t jpgHeight = decoder.height / (1 << (uint8_t)(jpeg->scale));
+  file.close();
+  return result;
+}
 
-    if(jpeg->offX >= jpgWidth || jpeg->offY >= jpgHeight){
-        log_e("Offset Outside of JPEG size");
-        return false;
-    }
+/***************************************************************************************
+** Function name:           playMjpeg
+** Description:             play a Motion-JPEG clip stored in FLASH
+***************************************************************************************/
+bool TFT_eFEX::playMjpeg(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, float fps, uint16_t loops, mjpeg_stats_t *stats)
+{
+  return mjpegPlay(nullptr, arrayname, array_size, xpos, ypos, fps, loops, stats);
+}
 
-    size_t jpgMaxWidth = jpgWidth - jpeg->offX;
-    size_t jpgMaxHeight = jpgHeight - jpeg->offY;
+/***************************************************************************************
+** Function name:           mjpegClock
+** Description:             microseconds since the clock was started, without wrapping
+***************************************************************************************/
+// micros() wraps after about 71 minutes, so its steps are added to a 64 bit count.
+// It must be called more often than that, mjpegPlay() calls it for every frame
+static uint64_t mjpegClock(uint64_t *clock, uint32_t *last)
+{
+  uint32_t now = micros();
+  *clock += (uint32_t)(now - *last);
+  *last = now;
+  return *clock;
+}
 
-    jpeg->outWidth = (jpgMaxWidth > jpeg->maxWidth)?jpeg->maxWidth:jpgMaxWidth;
-    jpeg->outHeight = (jpgMaxHeight > jpeg->maxHeight)?jpeg->maxHeight:jpgMaxHeight;
+/***************************************************************************************
+** Function name:           mjpegPlay
+** Description:             index a clip once, then draw the frames at the frame rate
+***************************************************************************************/
+bool TFT_eFEX::mjpegPlay(fs::File *file, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos, float fps, uint16_t loops, mjpeg_stats_t *stats)
+{
+  mjpeg_stats_t result;
+  memset(&result, 0, sizeof(result));
 
-    jres = jd_decomp(&decoder, jpgWrite, (uint8_t)jpeg->scale);
-    if(jres != JDR_OK){
-        log_e("jd_decomp failed! %s", jd_errors[jres]);
-        return false;
+  uint32_t indexTime = millis();
+  mjpeg_index_t index;
+  bool indexed = mjpegIndex(file, data, len, &index);
+  result.indexTime = millis() - indexTime;
+  result.frames = index.frames;
+
+  if (!indexed)
+  {
+    Serial.println(F("No Mjpeg frames found"));
+    free(index.offset);
+    free(index.length);
+    if (stats) *stats = result;
+    return false;
+  }
+
+  if (fps <= 0) fps = index.fps;
+  uint32_t period = (fps > 0) ? 1000000.0 / fps : 0; // Frame period in us, 0 = no pacing
+
+  uint64_t drawTotal = 0;
+  uint64_t clock = 0;  // Microseconds since playing started
+  uint32_t last = micros();
+  uint64_t frame = 0;  // Frame count since playing started
+
+  while (loops--)
+  {
+    for (uint32_t i = 0; i < index.frames; i++, frame++)
+    {
+      delay(0); // Equivalent to yield() for ESP8266;
+
+      if (period)
+      {
+        uint64_t due = frame * period;
+        // Drop the frame if its display slot has already passed
+        if (mjpegClock(&clock, &last) >= due + period)
+        {
+          result.dropped++;
+          continue;
+        }
+        while (mjpegClock(&clock, &last) < due) delay(0);
+      }
+
+      uint32_t drawTime = micros();
+      bool drawn = mjpegFrame(file, data, index.offset[i], index.length[i], xpos, ypos);
+      drawTime = micros() - drawTime;
+
+      // A corrupt frame is skipped, the clip plays on but false is returned at the end
+      if (!drawn)
+      {
+        result.failed++;
+        continue;
+      }
+
+      drawTotal += drawTime;
+      if (drawTime > result.maxDrawTime) result.maxDrawTime = drawTime;
+      result.drawn++;
     }
+  }
 
-    return true;
+  uint64_t elapsed = mjpegClock(&clock, &last);
+  if (elapsed) result.fps = result.drawn * 1000000.0 / elapsed;
+  if (result.drawn) result.drawTime = drawTotal / result.drawn;
+
+  free(index.offset);
+  free(index.length);
+
+  if (stats) *stats = result;
+  return (result.failed == 0);
 }
 
-#endif // ESP32 only
+/***************************************************************************************
+** Function name:           mjpegFrame
+** Description:             decode one indexed frame and push it to the TFT
+***************************************************************************************/
+#ifdef ESP32
+bool TFT_eFEX::mjpegFrame(fs::File *file, const uint8_t *data, uint32_t offset, uint32_t length, int16_t xpos, int16_t ypos)
+{
+  jpg_file_decoder_t jpeg;
+
+  if (file)
+  {
+    file->seek(offset);
+    jpeg.src = file;
+  }
+  else jpeg.src = data + offset;
+
+  jpeg.len = length;
+  jpeg.index = 0;
+  jpeg.x = xpos;
+  jpeg.y = ypos;
+  jpeg.maxWidth = 0xFFFF; // Clipped to the screen by jpgDecode()
+  jpeg.maxHeight = 0xFFFF;
+  jpeg.offX = 0;
+  jpeg.offY = 0;
+  jpeg.scale = JPEG_DIV_NONE;
+  jpeg.tft = _tft;
+  jpeg.inTransaction = false;
+  jpeg.previewShift = 0;
+  jpeg.spr = nullptr;
+  jpeg.stats = nullptr;
+  jpeg.work = jpgWorkBuffer();
+  jpeg.workSize = jpg_work_size;
+  jpgReadBuffer(&jpeg, file ? jpg_read_size : 0);
+  jpeg.resample = nullptr;
+  jpeg.dither = color_dither;
+
+  bool result = jpgDecode(&jpeg, file ? jpgReadFile : jpgRead);
+
+  free(jpeg.readBuf);
+  return result;
+}
+
+#else // Bundled decoder
+
+bool TFT_eFEX::mjpegFrame(fs::File *file, const uint8_t *data, uint32_t offset, uint32_t length, int16_t xpos, int16_t ypos)
+{
+  // The bundled decoder reads frames straight from the file, so no frame buffer is needed
+  if (file)
+  {
+    file->seek(offset);
+    return jpegRender(file, nullptr, length, xpos, ypos, nullptr, nullptr);
+  }
+
+  return jpegRender(nullptr, data + offset, length, xpos, ypos, nullptr, nullptr);
+}
+#endif
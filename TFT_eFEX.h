@@ -11,7 +11,8 @@
 
 #include <TFT_eSPI.h>
 
-#include <JPEGDecoder.h>
+#include "TFT_eFEX_Jpeg.h" // Bundled baseline jpeg decoder used by drawJpeg()
+#include "TFT_eFEX_Color.h" // RGB888 to 565 conversion, with optional ordered dithering
 
 // Call up the SPIFFS FLASH filing system this is part of the ESP Core
 #if defined (ESP8266) || defined (ESP32)
@@ -21,12 +22,13 @@
 
 #ifdef ESP32
   #include "rom/tjpgd.h" // For native ESP32 jpeg decoder
+  #include "esp_heap_caps.h" // For DMA capable buffers
   #include "SPIFFS.h"    // ESP32 only
 #endif
 
 // Screen server setup
 
-#define PIXEL_TIMEOUT 100     // 100ms Time-out between pixel requests
+#define PIXEL_TIMEOUT 100     // 100ms Time-out between pixel requests (or waiting for line credit with protocol 2)
 #define START_TIMEOUT 10000   // 10s Maximum time to wait at start transfer
 
 #define BITS_PER_PIXEL 16     // 24 for RGB colour format, 16 for 565 colour format
@@ -49,8 +51,27 @@
 // NPIXELS values and render times:
 // NPIXELS 1 = use readPixel() = >5s and 16 bit pixels only
 // NPIXELS >1 using rectRead() 2 = 1.75s, 4 = 1.68s, 8 = 1.67s
+// NPIXELS is not used by protocol 2 (client starts with 'V'), which reads and sends whole lines
 #define NPIXELS 1  // Must be integer division of both TFT width and TFT height
 
+// Line compression methods for protocol 2, the client says which it can decode and the
+// best one up to SCREEN_COMPRESSION is used. Flat colour screens compress a lot, with
+// LZ also copying from the line above. LZ needs 2 lines plus 512 bytes of RAM
+#define SCREEN_RAW 0
+#define SCREEN_RLE 1
+#define SCREEN_LZ  2
+#define SCREEN_COMPRESSION SCREEN_LZ
+
+#define JPG_BACKGROUNDS      4 // Number of images drawJpeg() remembers for restoreBackground()
+#define JPG_STREAM_BUFFER 1024 // Read-ahead ring buffer size for drawJpeg(Stream&, ...)
+#define JPG_WORK_SIZE     3100 // Default (and minimum) work buffer size for the ESP32 native decoder
+#define JPG_READ_BUFFER   4096 // Default file read-ahead buffer size for drawJpgFile(), 0 = unbuffered
+
+// Uncomment to send native decoder blocks with DMA, overlapping the transfer of each
+// block with decoding of the next. Needs TFT_eSPI with DMA support and tft.initDMA(),
+// blocks are pushed without DMA (and an error logged) if initDMA() has not been called
+//#define JPG_USE_DMA
+
 #ifdef ESP32 // For native jpeg decoder
 typedef enum {
     JPEG_DIV_NONE,
@@ -61,6 +82,77 @@ typedef enum {
 } jpeg_div_t;
 #endif
 
+// Per-stage timing (us) and counters, filled by the image drawing functions if a
+// pointer is passed. The bundled decoder used by drawJpeg() converts colours as it
+// decodes, so for drawJpeg() conversion is reported as part of decodeTime
+typedef struct {
+    uint32_t totalTime;   // Whole call
+    uint32_t readTime;    // File, array or Stream input
+    uint32_t decodeTime;  // Jpeg decoding
+    uint32_t convertTime; // Colour conversion to 565
+    uint32_t pushTime;    // Pushing pixels to the TFT or Sprite
+    uint32_t blocks;      // Jpeg MCUs or bitmap rows processed
+    uint32_t pixels;      // Pixels pushed
+    uint32_t bytesRead;   // Bytes read from the source
+    uint32_t peakBuffer;  // Largest working buffer used (bytes)
+} image_stats_t;
+
+// Dithering methods for drawJpegDithered() and drawBmpDithered()
+#define DITHER_ORDERED   0 // 4x4 Bayer matrix, no buffers at all
+#define DITHER_DIFFUSION 1 // Floyd-Steinberg error diffusion with a one row error buffer
+
+// 1 or 2 bit bitmap for an ePaper display, a 1 bit Sprite uses the same layout
+typedef struct {
+    uint8_t  *buf;   // Rows of (width * bits + 7) / 8 bytes, leftmost pixel in the MSBs
+    uint16_t  width;
+    uint16_t  height;
+    uint8_t   bits;  // 1 = black and white, 2 = 4 grays. Pixel value 0 is black
+} epd_bitmap_t;
+
+// Image drawn on the TFT by drawJpeg(), remembered for restoreBackground()
+typedef struct {
+    char          *path;  // File path, nullptr for an array
+    const uint8_t *data;  // Array address
+    uint32_t       size;  // Source size in bytes
+    int16_t        x;     // Where it was drawn
+    int16_t        y;
+    uint16_t       w;     // Image size
+    uint16_t       h;
+} jpeg_background_t;
+
+// Image cache counters reported by getImageCacheStats()
+typedef struct {
+    uint32_t hits;        // Images drawn from the cache
+    uint32_t misses;      // Images decoded (and added to the cache if they fit)
+    uint32_t evictions;   // Least recently used images removed to make room
+    uint32_t rejected;    // Images larger than the budget (or no RAM), drawn without caching
+    uint32_t entries;     // Images held now
+    uint32_t bytes;       // Pixel bytes held now
+    uint32_t budget;      // Pixel byte budget set by setImageCache()
+} image_cache_stats_t;
+
+// Thumbnail grid layout used by drawContactSheet()
+typedef struct {
+    int16_t  x;      // Top left corner of the sheet
+    int16_t  y;
+    uint16_t cellW;  // Maximum thumbnail size, larger thumbnails are cropped
+    uint16_t cellH;
+    uint16_t cols;   // Number of thumbnails per row
+    uint16_t gap;    // Spacing in pixels between cells
+} jpeg_grid_t;
+
+// Results reported by playMjpeg()
+typedef struct {
+    uint32_t frames;      // Frames found in the clip
+    uint32_t drawn;       // Frames decoded and pushed to the TFT
+    uint32_t dropped;     // Frames skipped to hold the frame rate
+    uint32_t failed;      // Frames that could not be decoded (corrupt or unsupported)
+    float    fps;         // Achieved frame rate
+    uint32_t indexTime;   // Time to build the frame index (ms)
+    uint32_t drawTime;    // Average decode and push time per frame (us)
+    uint32_t maxDrawTime; // Longest decode and push time (us)
+} mjpeg_stats_t;
+
 // End of screens erver setup
 
 class TFT_eFEX : public TFT_eSPI {
@@ -68,25 +160,74 @@ class TFT_eFEX : public TFT_eSPI {
  public:
 
   TFT_eFEX(TFT_eSPI *tft);
+  ~TFT_eFEX(void);
 
            // Draw a bezier curve of a defined colour between specified points
   void     drawBezier(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color);  
   void     drawBezierSegment(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color);
 
            // Draw a bitmap stored in SPIFFS to the TFT or a Sprite if a Sprite instance is included
-  void     drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr = nullptr);
+  void     drawBmp(String filename, int16_t x, int16_t y, TFT_eSprite *_spr = nullptr, image_stats_t *stats = nullptr);
 //To do:  void     drawBmp(const char *filename, int16_t x, int16_t y, TFT_eSprite *_spr = nullptr);
 
-           // Draw a Jpeg to the TFT, or to a Sprite if a Sprite instance is included (uses JPEGDecoder library)
-  void     drawJpeg(String filename, int16_t xpos, int16_t ypos, TFT_eSprite *_spr = nullptr);
+           // Draw a Jpeg to the TFT, or to a Sprite if a Sprite instance is included (uses the bundled decoder)
+  void     drawJpeg(String filename, int16_t xpos, int16_t ypos, TFT_eSprite *_spr = nullptr, image_stats_t *stats = nullptr);
+
+           // Draw a Jpeg stored in a program memory array to the TFT (uses the bundled decoder)
+  void     drawJpeg(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, TFT_eSprite *_spr = nullptr, image_stats_t *stats = nullptr);
+
+           // Draw a Jpeg arriving on a Stream (e.g. Serial or WiFiClient) to the TFT or a Sprite, length 0 if not known
+           // (uses the bundled decoder on all processors, so grayscale Jpegs can be drawn)
+  bool     drawJpeg(Stream &stream, uint32_t length, int16_t xpos, int16_t ypos, TFT_eSprite *_spr = nullptr, image_stats_t *stats = nullptr);
 
-           // Draw a Jpeg stored in a program memory array to the TFT (uses JPEGDecoder library)
-  void     drawJpeg(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, TFT_eSprite *_spr = nullptr);
+           // Dither a Jpeg or a 24 bit bmp from SPIFFS into a 1 bit or 2 bit (4 gray) bitmap for an ePaper display as it
+           // is decoded, no 565 frame is needed. e.g. for a 1 bit Sprite:
+           // epd_bitmap_t bm = { (uint8_t *)spr.getPointer(), (uint16_t)spr.width(), (uint16_t)spr.height(), 1 };
+  bool     drawJpegDithered(String filename, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method = DITHER_DIFFUSION);
+  bool     drawJpegDithered(const uint8_t arrayname[], uint32_t array_size, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method = DITHER_DIFFUSION);
+  bool     drawBmpDithered(String filename, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method = DITHER_DIFFUSION);
 
-           // List information about a Jpeg file to the Serial port (uses JPEGDecoder library)
+           // Decode Jpeg arrays that have restart markers in strips on both ESP32 cores (default off)
+  void     setJpegParallel(bool enable);
+
+           // Ordered dither 24 bit colours to 565 in drawBmp() and the ESP32 native decoder so gradients do not band (default off)
+  void     setColorDither(bool enable);
+
+           // Keep images decoded by drawJpeg() and drawBmp() in RAM (PSRAM if fitted), least recently used are
+           // dropped to stay within budget bytes of pixels. 0 (default) frees the cache and turns it off
+  void     setImageCache(uint32_t budget);
+  void     clearImageCache(void);
+  void     getImageCacheStats(image_cache_stats_t *stats);
+
+           // Redraw a rectangle of the TFT from the last images drawJpeg() drew there, e.g. to erase a moving
+           // needle or a popup. Only the Jpeg MCUs that overlap the rectangle are decoded (cached images are
+           // pushed straight from the cache). Returns false if part of the rectangle could not be restored
+  bool     restoreBackground(int16_t x, int16_t y, uint16_t w, uint16_t h);
+           // Forget the images remembered for restoreBackground(), e.g. after fillScreen()
+  void     clearBackground(void);
+
+           // List information about a Jpeg file to the Serial port
   void     jpegInfo(String filename);
   void     jpegInfo(const uint8_t arrayname[], uint32_t array_size);
 
+           // Draw a 1/8 scale thumbnail of a baseline Jpeg stored in SPIFFS or an array (only the DC coefficients are decoded)
+  bool     drawJpegThumb(String filename, int16_t xpos, int16_t ypos);
+  bool     drawJpegThumb(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos);
+
+           // Draw the thumbnail embedded in the EXIF data of a camera Jpeg, or a 1/8 scale thumbnail if there is none.
+           // orientation is set to the EXIF orientation (1-8, 1 = upright) or 0 if the image does not have one
+  bool     drawJpegThumbnail(String filename, int16_t xpos, int16_t ypos, uint8_t *orientation = nullptr, TFT_eSprite *_spr = nullptr);
+  bool     drawJpegThumbnail(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, uint8_t *orientation = nullptr, TFT_eSprite *_spr = nullptr);
+
+           // Draw a grid of Jpeg thumbnails from SPIFFS inside one SPI transaction, returns number drawn
+  uint16_t drawContactSheet(const char *paths[], uint16_t n, jpeg_grid_t grid);
+
+           // Play a Motion-JPEG clip (concatenated jpegs or AVI-MJPEG) from a file or array at a target frame rate
+           // fps = 0 uses the AVI frame rate or plays as fast as possible, late frames are dropped. Frames that cannot be
+           // decoded are skipped and counted in stats->failed, false is returned if there were any
+  bool     playMjpeg(fs::FS &fs, const char *path, int16_t xpos, int16_t ypos, float fps = 0, uint16_t loops = 1, mjpeg_stats_t *stats = nullptr);
+  bool     playMjpeg(const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos, float fps = 0, uint16_t loops = 1, mjpeg_stats_t *stats = nullptr);
+
            // Draw a progress bar on the screen
   void     drawProgressBar(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t percent, uint16_t frameColor, uint16_t barColor);
 
@@ -112,12 +253,23 @@ class TFT_eFEX : public TFT_eSPI {
            // Screen server call with or without a filename for PC stored image file
   bool     screenServer(void);
   bool     screenServer(String filename);
+           // Screen server sending a Sprite from its memory, no TFT reads (for TFTs with no MISO line)
+  bool     screenServer(TFT_eSprite &src, String filename = DEFAULT_FILENAME);
 
 #ifdef ESP32
-           // Draw a jpeg stored in an array using the ESP32 native decoder, can crop and scale
-  bool     drawJpg(const uint8_t * jpg_data, size_t jpg_len, uint16_t x=0, uint16_t y=0, uint16_t maxWidth=0, uint16_t maxHeight=0, uint16_t offX=0, uint16_t offY=0, jpeg_div_t scale=JPEG_DIV_NONE);
+           // Draw a jpeg stored in an array using the ESP32 native decoder, can crop and scale, to the TFT or a Sprite
+  bool     drawJpg(const uint8_t * jpg_data, size_t jpg_len, int16_t x=0, int16_t y=0, uint16_t maxWidth=0, uint16_t maxHeight=0, uint16_t offX=0, uint16_t offY=0, jpeg_div_t scale=JPEG_DIV_NONE, image_stats_t *stats=nullptr, TFT_eSprite *spr=nullptr);
            // Draw a jpeg stored in a file using the ESP32 native decoder, can crop and scale (Tested with SPIFFS file)
-  bool     drawJpgFile(fs::FS &fs, const char * path, uint16_t x=0, uint16_t y=0, uint16_t maxWidth=0, uint16_t maxHeight=0, uint16_t offX=0, uint16_t offY=0, jpeg_div_t scale=JPEG_DIV_NONE);
+  bool     drawJpgFile(fs::FS &fs, const char * path, int16_t x=0, int16_t y=0, uint16_t maxWidth=0, uint16_t maxHeight=0, uint16_t offX=0, uint16_t offY=0, jpeg_div_t scale=JPEG_DIV_NONE, image_stats_t *stats=nullptr, TFT_eSprite *spr=nullptr);
+           // Draw a jpeg from an array or file resized to fit a width x height box (0 = rest of the screen), keeping the aspect ratio
+  bool     drawJpgScaled(const uint8_t * jpg_data, size_t jpg_len, int16_t x, int16_t y, uint16_t width = 0, uint16_t height = 0, TFT_eSprite *spr = nullptr, image_stats_t *stats = nullptr);
+  bool     drawJpgFileScaled(fs::FS &fs, const char * path, int16_t x, int16_t y, uint16_t width = 0, uint16_t height = 0, TFT_eSprite *spr = nullptr, image_stats_t *stats = nullptr);
+           // Paint a coarse 1/8 scale preview before the full resolution image in drawJpg() and drawJpgFile()
+  void     setJpgPreview(bool enable);
+           // Set the native decoder work buffer for this instance, buf = nullptr allocates size bytes
+  bool     setJpgWorkBuffer(uint8_t *buf, uint32_t size = JPG_WORK_SIZE);
+           // Set the file read-ahead buffer size used by drawJpgFile(), 0 for unbuffered reads
+  void     setJpgReadBuffer(uint32_t size);
 #endif
 
   private:
@@ -128,13 +280,73 @@ class TFT_eFEX : public TFT_eSPI {
   uint16_t read16(fs::File &f);
   uint32_t read32(fs::File &f);
 
-  bool     serialScreenServer(String filename);
-  void     sendParameters(String filename);
+           // Support functions for the drawJpeg() functions
+  bool     jpegRender(fs::File *file, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos, TFT_eSprite *_spr,
+                      image_stats_t *stats, uint8_t scale = 0, uint16_t maxWidth = 0, uint16_t maxHeight = 0, bool inTransaction = false,
+                      uint16_t offX = 0, uint16_t offY = 0, struct jpg_stream_t *stream = nullptr);
+  static bool jpegOutput(void *dev, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *pixels);
+  void     jpegHeader(fs::File *file, const uint8_t *data, uint32_t len);
+  void     pushPanelImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, TFT_eSprite *_spr, bool inTransaction = false);
+  void     pushPanelImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t *data, TFT_eSprite *_spr);
+
+           // Support functions for the image cache
+  bool     jpegCached(fs::File *file, const char *path, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos,
+                      TFT_eSprite *_spr, image_stats_t *stats);
+  struct image_cache_entry_t *cacheFind(const char *path, const uint8_t *data, uint32_t size, uint32_t mtime, bool count = true);
+  struct image_cache_entry_t *cacheAdd(const char *path, const uint8_t *data, uint32_t size, uint32_t mtime, uint16_t w, uint16_t h);
+  void     cacheRemove(struct image_cache_entry_t *entry);
+  void     cacheDraw(struct image_cache_entry_t *entry, int16_t x, int16_t y, TFT_eSprite *_spr, image_stats_t *stats);
+
+           // Support function for drawJpegDithered()
+  bool     jpegDither(fs::File *file, const uint8_t *data, uint32_t len, int16_t x, int16_t y, epd_bitmap_t *bitmap, uint8_t method);
+
+           // Support functions for restoreBackground()
+  void     backgroundAdd(const char *path, const uint8_t *data, uint32_t size, int16_t x, int16_t y);
+  bool     backgroundDraw(jpeg_background_t *bg, int16_t x, int16_t y, uint16_t w, uint16_t h);
+
+           // Support function for drawJpegThumb() and drawContactSheet()
+  bool     jpegThumb(String filename, const uint8_t arrayname[], uint32_t array_size, int16_t xpos, int16_t ypos,
+                     uint16_t maxWidth, uint16_t maxHeight, bool inTransaction);
+
+           // Support functions for drawJpegThumbnail()
+  bool     jpegThumbnail(fs::File *file, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos, uint8_t *orientation, TFT_eSprite *_spr);
+  bool     exifThumbnail(fs::File *file, const uint8_t *data, uint32_t len, uint32_t *offset, uint32_t *length, uint8_t *orientation);
+
+           // Support functions for playMjpeg()
+  bool     mjpegPlay(fs::File *file, const uint8_t *data, uint32_t len, int16_t xpos, int16_t ypos, float fps, uint16_t loops, mjpeg_stats_t *stats);
+  bool     mjpegFrame(fs::File *file, const uint8_t *data, uint32_t offset, uint32_t length, int16_t xpos, int16_t ypos);
+
+#ifdef ESP32
+           // Support function for the native jpeg decoder
+  uint8_t *jpgWorkBuffer(void);
+#endif
+
+  bool     serialScreenServer(String filename, TFT_eSprite *spr = nullptr);
+  bool     serialScreenStream(uint8_t compression, TFT_eSprite *spr);
+  void     screenLine(TFT_eSprite *spr, uint16_t x, uint16_t y, uint16_t w, uint8_t *buf, uint8_t bytes);
+  void     sendParameters(String filename, uint8_t version = 1, uint8_t compression = SCREEN_RAW, TFT_eSprite *spr = nullptr);
  protected:
 
 int32_t rtl_cursorX = 0; // RTL cursor positions
 int32_t rtl_cursorY = 0;
 
+bool    jpg_preview = false; // Two pass preview-then-refine drawing for drawJpg() and drawJpgFile()
+bool    jpeg_parallel = false; // Decode drawJpeg() arrays with restart markers on two cores
+bool    color_dither = false;  // Ordered dither RGB888 to 565 in drawBmp() and the native decoder
+
+uint8_t *jpg_work = nullptr;  // Native decoder work buffer, allocated on first use
+uint32_t jpg_work_size = JPG_WORK_SIZE;
+bool    jpg_work_owned = false;
+uint32_t jpg_read_size = JPG_READ_BUFFER; // File read-ahead buffer size for the native decoder
+
+struct image_cache_entry_t *img_cache = nullptr; // Decoded images, most recently used first
+image_cache_stats_t img_cache_stats = {};        // Counters and budget, budget 0 = cache off
+
+jpeg_background_t jpg_bg[JPG_BACKGROUNDS] = {};  // Images drawn by drawJpeg(), oldest first
+uint8_t  jpg_bg_count = 0;
+uint16_t jpeg_width = 0;  // Size of the last image decoded by jpegRender() or jpegCached()
+uint16_t jpeg_height = 0;
+
 };
 
 #endif //ifndef _TFT_eFEXH_
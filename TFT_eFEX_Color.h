@@ -0,0 +1,165 @@
+/***************************************************************************************
+// RGB888 to RGB565 conversion shared by the TFT_eFEX image drawing functions
+
+// Plain C++ with no Arduino dependencies, so the "convert_bench" PC program in the
+// "Jpeg_Benchmark" example host folder times the same code the library runs.
+
+// rgb565Row() converts four pixels per iteration from three 32 bit loads (SWAR) when
+// the buffers are word aligned, with a pixel at a time tail. Built for a PC with SSE2
+// (any x86-64) it converts eight pixels per iteration with SSE2 instead. Little endian
+// processors only, which covers the ESP8266, ESP32 and x86.
+
+// Truncating 8 bit channels to 5 or 6 bits bands smooth gradients. The dithered
+// converter adds a 4x4 ordered (Bayer) dither offset to each channel first, the
+// offsets for a row are looked up once so each pixel only costs a shift, a subtract
+// and an add per channel more than plain truncation.
+***************************************************************************************/
+
+#ifndef _TFT_eFEX_ColorH_
+#define _TFT_eFEX_ColorH_
+
+#include <stdint.h>
+
+#if defined (__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+// 4x4 Bayer matrix, thresholds 0-15
+static const uint8_t ditherBayer[4][4] = {
+  {  0,  8,  2, 10 },
+  { 12,  4, 14,  6 },
+  {  3, 11,  1,  9 },
+  { 15,  7, 13,  5 }
+};
+
+// Dither offsets for four pixels of one row. Red and blue lose 3 bits so get 0-7,
+// green loses 2 bits so gets 0-3
+typedef struct {
+  uint8_t rb[4];
+  uint8_t g[4];
+} dither565_t;
+
+// Offsets for row y, rotated so that rb[0] and g[0] are those of pixel x
+static inline void dither565Row(dither565_t *d, int32_t x, int32_t y)
+{
+  for (uint8_t i = 0; i < 4; i++) {
+    uint8_t t = ditherBayer[y & 3][(x + i) & 3];
+    d->rb[i] = t >> 1;
+    d->g[i]  = t >> 2;
+  }
+}
+
+// Add a dither offset to an 8 bit channel and keep the top bits given by mask. The
+// channel is first scaled by 31/32 (63/64 for green) so that on average 255 maps to
+// the top 5 (6) bit level rather than 256 above it, which also means the sum never
+// passes 255 and needs no clamp
+#define ditherAdd(c, d, shift, mask) (((c) - ((c) >> (shift)) + (d)) & (mask))
+
+// The converters below take n 24 bit pixels. bgr is set for bmp (B, G, R) byte order,
+// swap gives panel byte order (MSB first in memory). dst may overlap src if it starts
+// at src, as drawBmp() converts in place
+
+// Pack one pixel from channels held in the low byte of 32 bit values
+static inline uint32_t rgb565Pack(uint32_t r, uint32_t g, uint32_t b, bool swap)
+{
+  if (swap) return (r & 0xF8) | ((g & 0xE0) >> 5) | ((g & 0x1C) << 11) | ((b & 0xF8) << 5);
+  return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | ((b & 0xF8) >> 3);
+}
+
+// One pixel at a time
+static inline void rgb565Scalar(const uint8_t *src, uint16_t *dst, uint32_t n, bool bgr, bool swap)
+{
+  const uint8_t ri = bgr ? 2 : 0, bi = bgr ? 0 : 2;
+
+  for (uint32_t i = 0; i < n; i++) {
+    dst[i] = rgb565Pack(src[ri], src[1], src[bi], swap);
+    src += 3;
+  }
+}
+
+// Four pixels loaded as three 32 bit words and stored as two, needs word aligned buffers
+static inline void rgb565Swar(const uint8_t *src, uint16_t *dst, uint32_t n, bool bgr, bool swap)
+{
+  if (!((uintptr_t)src & 3) && !((uintptr_t)dst & 3)) {
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+    while (n >= 4) {
+      // Bytes, lowest first: w0 = a0 b0 c0 a1, w1 = b1 c1 a2 b2, w2 = c2 a3 b3 c3
+      // where a is red (blue for bgr), b is green and c is blue (red for bgr)
+      uint32_t w0 = s[0], w1 = s[1], w2 = s[2];
+      uint32_t a0 = w0, c0 = w0 >> 16, a1 = w0 >> 24, c1 = w1 >> 8;
+      uint32_t a2 = w1 >> 16, c2 = w2, a3 = w2 >> 8, c3 = w2 >> 24;
+      d[0] = rgb565Pack(bgr ? c0 : a0, w0 >> 8, bgr ? a0 : c0, swap) | (rgb565Pack(bgr ? c1 : a1, w1, bgr ? a1 : c1, swap) << 16);
+      d[1] = rgb565Pack(bgr ? c2 : a2, w1 >> 24, bgr ? a2 : c2, swap) | (rgb565Pack(bgr ? c3 : a3, w2 >> 16, bgr ? a3 : c3, swap) << 16);
+      s += 3;
+      d += 2;
+      n -= 4;
+    }
+    src = (const uint8_t *)s;
+    dst = (uint16_t *)d;
+  }
+  rgb565Scalar(src, dst, n, bgr, swap);
+}
+
+#if defined (__SSE2__)
+// Four pixels from 16 byte unaligned loads, with each pixel moved into its own 32 bit lane
+static inline __m128i rgb565Lanes(const uint8_t *src, bool bgr)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)src);
+  __m128i p = _mm_unpacklo_epi64(_mm_unpacklo_epi32(v, _mm_srli_si128(v, 3)),
+                                 _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9)));
+  __m128i lo = _mm_set1_epi32(0xF8), g = _mm_and_si128(p, _mm_set1_epi32(0xFC00)), hi = _mm_set1_epi32(0xF80000);
+  __m128i r, b;
+  if (bgr) {
+    r = _mm_srli_epi32(_mm_and_si128(p, hi), 8);
+    b = _mm_srli_epi32(_mm_and_si128(p, lo), 3);
+  } else {
+    r = _mm_slli_epi32(_mm_and_si128(p, lo), 8);
+    b = _mm_srli_epi32(_mm_and_si128(p, hi), 19);
+  }
+  // 565 less 0x8000, so the signed saturating pack to 16 bits leaves it unchanged
+  return _mm_sub_epi32(_mm_or_si128(_mm_or_si128(r, _mm_srli_epi32(g, 5)), b), _mm_set1_epi32(0x8000));
+}
+
+// Eight pixels per iteration, the loads read 4 bytes past the eighth pixel
+static inline void rgb565Sse2(const uint8_t *src, uint16_t *dst, uint32_t n, bool bgr, bool swap)
+{
+  while (n >= 10) {
+    __m128i c = _mm_add_epi16(_mm_packs_epi32(rgb565Lanes(src, bgr), rgb565Lanes(src + 12, bgr)), _mm_set1_epi16((short)0x8000));
+    if (swap) c = _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+    _mm_storeu_si128((__m128i *)dst, c);
+    src += 24;
+    dst += 8;
+    n -= 8;
+  }
+  rgb565Scalar(src, dst, n, bgr, swap);
+}
+#endif
+
+// Convert with the fastest converter for the processor
+static inline void rgb565Row(const uint8_t *src, uint16_t *dst, uint32_t n, bool bgr, bool swap)
+{
+#if defined (__SSE2__)
+  rgb565Sse2(src, dst, n, bgr, swap);
+#else
+  rgb565Swar(src, dst, n, bgr, swap);
+#endif
+}
+
+// As rgb565Row() with ordered dithering, x and y are the position of the first pixel
+// on the screen (or in the image) so the pattern lines up from one call to the next
+static inline void rgb565DitherRow(const uint8_t *src, uint16_t *dst, uint32_t n, int32_t x, int32_t y, bool bgr, bool swap)
+{
+  const uint8_t ri = bgr ? 2 : 0, bi = bgr ? 0 : 2;
+  dither565_t d;
+  dither565Row(&d, x, y);
+
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t  j = i & 3;
+    uint16_t c = (ditherAdd(src[ri], d.rb[j], 5, 0xF8) << 8) | (ditherAdd(src[1], d.g[j], 6, 0xFC) << 3) | (ditherAdd(src[bi], d.rb[j], 5, 0xF8) >> 3);
+    dst[i] = swap ? (c >> 8) | (c << 8) : c;
+    src += 3;
+  }
+}
+
+#endif
@@ -0,0 +1,1355 @@
+/***************************************************************************************
+// Baseline Jpeg decoder bundled with TFT_eFEX, see TFT_eFEX_Jpeg.h
+***************************************************************************************/
+
+#include "TFT_eFEX_Jpeg.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Natural order index of each zigzag ordered coefficient, padded so a corrupt run
+// length cannot index past the end
+static const uint8_t fjpgZigzag[64 + 16] = {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+  63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+};
+
+// AAN IDCT scale factors (natural order, scaled by 2^14), folded into the
+// dequantisation multipliers so the IDCT needs only 5 multiplies per row or column
+static const uint16_t fjpgAanScales[64] = {
+  16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+  22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+  21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+  19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+  16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+  12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+   8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+   4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
+};
+
+// IDCT constants (scaled by 2^8)
+#define FJPG_1_082392200  277
+#define FJPG_1_414213562  362
+#define FJPG_1_847759065  473
+#define FJPG_2_613125930  669
+#define FJPG_MUL(v, c)    (((v) * (c)) >> 8)
+
+// The dequantised coefficients carry 2 extra fraction bits, 3 more come from the IDCT
+#define FJPG_PASS1_BITS   2
+#define FJPG_DESCALE      (FJPG_PASS1_BITS + 3)
+
+static inline uint8_t fjpgClamp(int32_t v)
+{
+  if ((uint32_t)v > 255) return (v < 0) ? 0 : 255;
+  return v;
+}
+
+// Sign extend an n bit coefficient value
+static inline int32_t fjpgExtend(int32_t v, uint8_t n)
+{
+  return (v < (1 << (n - 1))) ? v + 1 - (1 << n) : v;
+}
+
+// Dequantised coefficients of real images stay well inside +/-16383, limiting corrupt
+// data to this keeps the IDCT arithmetic inside 32 bits
+static inline int32_t fjpgCoef(int32_t v)
+{
+  return (v > 16383) ? 16383 : (v < -16383) ? -16383 : v;
+}
+
+// DC only block value
+static inline uint8_t fjpgDcValue(int32_t dc)
+{
+  return fjpgClamp(((dc + (1 << (FJPG_DESCALE - 1))) >> FJPG_DESCALE) + 128);
+}
+
+/***************************************************************************************
+** Function name:           fjpgBuildHuff
+** Description:             build the lookup and canonical decode tables
+***************************************************************************************/
+static bool fjpgBuildHuff(fjpg_huff_t *h, const uint8_t counts[16])
+{
+  uint32_t code = 0;
+  uint16_t k = 0;
+
+  memset(h->lookup, 0, sizeof(h->lookup));
+
+  for (uint8_t len = 1; len <= 16; len++)
+  {
+    h->valOffset[len] = (int32_t)k - (int32_t)code;
+    for (uint8_t i = 0; i < counts[len - 1]; i++)
+    {
+      if (code >= (1UL << len)) return false; // Over-subscribed code lengths
+      if (len <= FJPG_LOOKUP_BITS)
+      {
+        // Every lookup index starting with this code decodes to the symbol
+        uint16_t first = code << (FJPG_LOOKUP_BITS - len);
+        uint16_t n = 1 << (FJPG_LOOKUP_BITS - len);
+        for (uint16_t j = 0; j < n; j++) h->lookup[first + j] = (len << 8) | h->symbols[k];
+      }
+      code++;
+      k++;
+    }
+    h->maxCode[len] = counts[len - 1] ? (int32_t)code - 1 : -1;
+    code <<= 1;
+  }
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           fjpgBuildFastAc
+** Description:             decode run, value and length of short AC codes in one lookup
+***************************************************************************************/
+static void fjpgBuildFastAc(const fjpg_huff_t *h, int16_t *fast)
+{
+  for (uint16_t i = 0; i < (1 << FJPG_LOOKUP_BITS); i++)
+  {
+    fast[i] = 0;
+    uint16_t e = h->lookup[i];
+    if (!e) continue;
+
+    uint8_t len = e >> 8;
+    uint8_t run = (e >> 4) & 0x0F;
+    uint8_t s   = e & 0x0F;
+    if (!s || (len + s > FJPG_LOOKUP_BITS)) continue;
+
+    int32_t v = fjpgExtend((i >> (FJPG_LOOKUP_BITS - len - s)) & ((1 << s) - 1), s);
+    if (v < -128 || v > 127) continue;
+
+    fast[i] = (int16_t)(v * 256 + (run << 4) + len + s);
+  }
+}
+
+/***************************************************************************************
+** Function name:           readByte
+** Description:             return the next input byte, 0 at the end of the data
+***************************************************************************************/
+uint8_t TFT_eFEX_Jpeg::readByte(void)
+{
+  if (inPos >= inLen)
+  {
+    if (inEnd) return 0;
+    inLen = _input(_src, inBuf, FJPG_INPUT_BUFFER);
+    inPos = 0;
+    inCount += inLen;
+    if (!inLen)
+    {
+      inEnd = true;
+      return 0;
+    }
+  }
+  return inBuf[inPos++];
+}
+
+/***************************************************************************************
+** Function name:           readWord
+** Description:             read a big endian 16 bit value from the headers
+***************************************************************************************/
+bool TFT_eFEX_Jpeg::readWord(uint16_t *w)
+{
+  *w = readByte() << 8;
+  *w |= readByte();
+  return !inEnd;
+}
+
+/***************************************************************************************
+** Function name:           skip
+** Description:             skip n input bytes
+***************************************************************************************/
+bool TFT_eFEX_Jpeg::skip(uint32_t n)
+{
+  uint32_t buffered = inLen - inPos;
+  if (n <= buffered)
+  {
+    inPos += n;
+    return true;
+  }
+  inPos = inLen;
+  n -= buffered;
+  uint32_t skipped = _input(_src, nullptr, n);
+  inCount += skipped;
+  return skipped == n;
+}
+
+/***************************************************************************************
+** Function name:           fillBits
+** Description:             top up the bit buffer to at least 25 bits
+***************************************************************************************/
+// Stuffed zero bytes are removed. At a marker (or the end of the data) zero bits are
+// fed in and the marker is kept for restart()
+void TFT_eFEX_Jpeg::fillBits(void)
+{
+  while (bitCount <= 24)
+  {
+    uint32_t b = 0;
+    if (!marker)
+    {
+      b = readByte();
+      if (inEnd)
+      {
+        marker = 0xD9;
+        b = 0;
+      }
+      else if (b == 0xFF)
+      {
+        uint8_t c = readByte();
+        while (c == 0xFF) c = readByte();
+        if (c)
+        {
+          marker = c;
+          b = 0;
+        }
+      }
+    }
+    bitBuf |= b << (24 - bitCount);
+    bitCount += 8;
+  }
+}
+
+/***************************************************************************************
+** Function name:           getBits
+** Description:             take n (1-16) bits from the bit buffer
+***************************************************************************************/
+inline int32_t TFT_eFEX_Jpeg::getBits(uint8_t n)
+{
+  if (bitCount < n) fillBits();
+  int32_t v = bitBuf >> (32 - n);
+  bitBuf <<= n;
+  bitCount -= n;
+  return v;
+}
+
+/***************************************************************************************
+** Function name:           decodeHuff
+** Description:             decode one Huffman symbol, -1 if the code is invalid
+***************************************************************************************/
+// The caller makes sure there are at least 16 bits in the buffer
+inline int16_t TFT_eFEX_Jpeg::decodeHuff(fjpg_huff_t *h)
+{
+  uint16_t e = h->lookup[bitBuf >> (32 - FJPG_LOOKUP_BITS)];
+  if (e)
+  {
+    uint8_t len = e >> 8;
+    bitBuf <<= len;
+    bitCount -= len;
+    return e & 0xFF;
+  }
+
+  // Longer codes
+  for (uint8_t len = FJPG_LOOKUP_BITS + 1; len <= 16; len++)
+  {
+    int32_t code = bitBuf >> (32 - len);
+    if (code <= h->maxCode[len])
+    {
+      bitBuf <<= len;
+      bitCount -= len;
+      return h->symbols[(h->valOffset[len] + code) & 0xFF];
+    }
+  }
+  return -1;
+}
+
+/***************************************************************************************
+** Function name:           restart
+** Description:             find and step over a restart marker, reset the predictions
+***************************************************************************************/
+bool TFT_eFEX_Jpeg::restart(void)
+{
+  bitBuf = 0;
+  bitCount = 0;
+
+  // The marker may not have been reached by the bit buffer yet
+  while (!marker && !inEnd)
+  {
+    if (readByte() != 0xFF) continue;
+    uint8_t c = readByte();
+    while (c == 0xFF) c = readByte();
+    marker = c;
+  }
+
+  if ((marker & 0xF8) != 0xD0) return false;
+
+  marker = 0;
+  comp[0].pred = comp[1].pred = comp[2].pred = 0;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           decodeBlock
+** Description:             decode and dequantise one 8x8 block into coef[]
+***************************************************************************************/
+// If dcOnly is true the AC coefficients are decoded and thrown away (only coef[0] is
+// set). acZero is set true if the block has no AC coefficients, so the IDCT can be skipped
+bool TFT_eFEX_Jpeg::decodeBlock(fjpg_comp_t *c, bool dcOnly, bool *acZero)
+{
+  const int32_t *q = qt[c->qt];
+  fjpg_huff_t *ac = &huff[1][c->ac];
+  const int16_t *fast = fastAc[c->ac];
+
+  // DC coefficient, coded as the difference from the last block of the component
+  if (bitCount < 16) fillBits();
+  int16_t s = decodeHuff(&huff[0][c->dc]);
+  if (s < 0 || s > 11) return false;
+  if (s)
+  {
+    c->pred += fjpgExtend(getBits(s), s);
+    if (c->pred > 4095 || c->pred < -4095) c->pred = (c->pred < 0) ? -4095 : 4095; // Corrupt data
+  }
+
+  if (dcOnly)
+  {
+    coef[0] = fjpgCoef(c->pred * q[0]);
+    *acZero = true;
+
+    for (uint8_t k = 1; k < 64; )
+    {
+      if (bitCount < 16) fillBits();
+      int16_t fa = fast[bitBuf >> (32 - FJPG_LOOKUP_BITS)];
+      if (fa)
+      {
+        k += ((fa >> 4) & 0x0F) + 1;
+        bitBuf <<= (fa & 0x0F);
+        bitCount -= (fa & 0x0F);
+        continue;
+      }
+      int16_t rs = decodeHuff(ac);
+      if (rs < 0) return false;
+      uint8_t r = rs >> 4;
+      s = rs & 0x0F;
+      if (s)
+      {
+        k += r + 1;
+        getBits(s);
+      }
+      else
+      {
+        if (r != 15) break; // End of block
+        k += 16;
+      }
+    }
+    return true;
+  }
+
+  memset(coef, 0, sizeof(coef));
+  coef[0] = fjpgCoef(c->pred * q[0]);
+  bool zero = true;
+
+  for (uint8_t k = 1; k < 64; )
+  {
+    if (bitCount < 16) fillBits();
+    int16_t fa = fast[bitBuf >> (32 - FJPG_LOOKUP_BITS)];
+    if (fa)
+    {
+      // Run, value and length from one lookup
+      k += (fa >> 4) & 0x0F;
+      bitBuf <<= (fa & 0x0F);
+      bitCount -= (fa & 0x0F);
+      if (k > 63) return false;
+      coef[fjpgZigzag[k]] = fjpgCoef((fa >> 8) * q[k]);
+      zero = false;
+      k++;
+      continue;
+    }
+    int16_t rs = decodeHuff(ac);
+    if (rs < 0) return false;
+    uint8_t r = rs >> 4;
+    s = rs & 0x0F;
+    if (s > 10) return false; // AC values are at most 10 bits for 8 bit samples
+    if (s)
+    {
+      k += r;
+      if (k > 63) return false;
+      coef[fjpgZigzag[k]] = fjpgCoef(fjpgExtend(getBits(s), s) * q[k]);
+      zero = false;
+      k++;
+    }
+    else
+    {
+      if (r != 15) break; // End of block
+      k += 16;
+    }
+  }
+
+  *acZero = zero;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           idct
+** Description:             fixed point AAN inverse DCT of coef[] to 8x8 samples
+***************************************************************************************/
+// Columns then rows, each a 5 multiply AAN butterfly. Columns and rows with no AC
+// terms are filled with their DC term
+void TFT_eFEX_Jpeg::idct(uint8_t *out, uint8_t stride)
+{
+  int32_t ws[64];
+  int32_t *in = coef;
+  int32_t *w = ws;
+
+  for (uint8_t i = 0; i < 8; i++, in++, w++)
+  {
+    if (!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56]))
+    {
+      w[0] = w[8] = w[16] = w[24] = w[32] = w[40] = w[48] = w[56] = in[0];
+      continue;
+    }
+
+    // Even part
+    int32_t t10 = in[0] + in[32];
+    int32_t t11 = in[0] - in[32];
+    int32_t t13 = in[16] + in[48];
+    int32_t t12 = FJPG_MUL(in[16] - in[48], FJPG_1_414213562) - t13;
+
+    int32_t t0 = t10 + t13;
+    int32_t t3 = t10 - t13;
+    int32_t t1 = t11 + t12;
+    int32_t t2 = t11 - t12;
+
+    // Odd part
+    int32_t z13 = in[40] + in[24];
+    int32_t z10 = in[40] - in[24];
+    int32_t z11 = in[8] + in[56];
+    int32_t z12 = in[8] - in[56];
+
+    int32_t t7 = z11 + z13;
+    t11 = FJPG_MUL(z11 - z13, FJPG_1_414213562);
+    int32_t z5 = FJPG_MUL(z10 + z12, FJPG_1_847759065);
+    t10 = FJPG_MUL(z12, FJPG_1_082392200) - z5;
+    t12 = FJPG_MUL(z10, -FJPG_2_613125930) + z5;
+
+    int32_t t6 = t12 - t7;
+    int32_t t5 = t11 - t6;
+    int32_t t4 = t10 + t5;
+
+    w[0]  = t0 + t7;
+    w[56] = t0 - t7;
+    w[8]  = t1 + t6;
+    w[48] = t1 - t6;
+    w[16] = t2 + t5;
+    w[40] = t2 - t5;
+    w[32] = t3 + t4;
+    w[24] = t3 - t4;
+  }
+
+  w = ws;
+  const int32_t round = (1 << (FJPG_DESCALE - 1)) + (128 << FJPG_DESCALE);
+
+  for (uint8_t i = 0; i < 8; i++, w += 8, out += stride)
+  {
+    if (!(w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7]))
+    {
+      uint8_t v = fjpgClamp((w[0] + round) >> FJPG_DESCALE);
+      memset(out, v, 8);
+      continue;
+    }
+
+    // Even part
+    int32_t t10 = w[0] + w[4];
+    int32_t t11 = w[0] - w[4];
+    int32_t t13 = w[2] + w[6];
+    int32_t t12 = FJPG_MUL(w[2] - w[6], FJPG_1_414213562) - t13;
+
+    int32_t t0 = t10 + t13;
+    int32_t t3 = t10 - t13;
+    int32_t t1 = t11 + t12;
+    int32_t t2 = t11 - t12;
+
+    // Odd part
+    int32_t z13 = w[5] + w[3];
+    int32_t z10 = w[5] - w[3];
+    int32_t z11 = w[1] + w[7];
+    int32_t z12 = w[1] - w[7];
+
+    int32_t t7 = z11 + z13;
+    t11 = FJPG_MUL(z11 - z13, FJPG_1_414213562);
+    int32_t z5 = FJPG_MUL(z10 + z12, FJPG_1_847759065);
+    t10 = FJPG_MUL(z12, FJPG_1_082392200) - z5;
+    t12 = FJPG_MUL(z10, -FJPG_2_613125930) + z5;
+
+    int32_t t6 = t12 - t7;
+    int32_t t5 = t11 - t6;
+    int32_t t4 = t10 + t5;
+
+    out[0] = fjpgClamp((t0 + t7 + round) >> FJPG_DESCALE);
+    out[7] = fjpgClamp((t0 - t7 + round) >> FJPG_DESCALE);
+    out[1] = fjpgClamp((t1 + t6 + round) >> FJPG_DESCALE);
+    out[6] = fjpgClamp((t1 - t6 + round) >> FJPG_DESCALE);
+    out[2] = fjpgClamp((t2 + t5 + round) >> FJPG_DESCALE);
+    out[5] = fjpgClamp((t2 - t5 + round) >> FJPG_DESCALE);
+    out[4] = fjpgClamp((t3 + t4 + round) >> FJPG_DESCALE);
+    out[3] = fjpgClamp((t3 - t4 + round) >> FJPG_DESCALE);
+  }
+}
+
+/***************************************************************************************
+** Function name:           shrink
+** Description:             box average a w x h sample plane by 2^scale in place
+***************************************************************************************/
+// The result has a stride of stride >> scale. Each output sample is written after
+// the samples it is made from have been read, so this is safe in place
+void TFT_eFEX_Jpeg::shrink(uint8_t *buf, uint8_t stride, uint8_t w, uint8_t h, uint8_t scale)
+{
+  uint8_t n = 1 << scale;
+  uint8_t outStride = stride >> scale;
+  uint16_t round = 1 << (2 * scale - 1);
+
+  for (uint8_t oy = 0; oy < (h >> scale); oy++)
+  {
+    for (uint8_t ox = 0; ox < (w >> scale); ox++)
+    {
+      uint16_t sum = 0;
+      uint8_t *p = buf + (oy << scale) * stride + (ox << scale);
+      for (uint8_t y = 0; y < n; y++, p += stride)
+      {
+        for (uint8_t x = 0; x < n; x++) sum += p[x];
+      }
+      buf[oy * outStride + ox] = (sum + round) >> (2 * scale);
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           grayTable
+** Description:             fill the Y to pixel lookup table for grayscale images
+***************************************************************************************/
+// Built for the pixel format and byte order in use, so convert() is one lookup per pixel
+void TFT_eFEX_Jpeg::grayTable(void)
+{
+  for (uint16_t v = 0; v < 256; v++)
+  {
+    uint16_t c;
+    if (rgb332) c = (v & 0xE0) | ((v & 0xE0) >> 3) | (v >> 6);
+    else
+    {
+      c = ((v & 0xF8) << 8) | ((v & 0xFC) << 3) | (v >> 3);
+      if (swapBytes) c = (c >> 8) | (c << 8);
+    }
+    grayLut[v] = c;
+  }
+}
+
+/***************************************************************************************
+** Function name:           convert
+** Description:             convert the MCU samples to 565 (or RGB332) pixels
+***************************************************************************************/
+// Chroma is sampled at 1/(1 << hShift) x 1/(1 << vShift) of luma, each chroma sample is
+// used for all the luma samples it covers. Integer JFIF YCbCr to RGB with 16 fraction bits.
+// Grayscale images skip all chroma work and use the grayTable() lookup
+void TFT_eFEX_Jpeg::convert(uint16_t w, uint16_t h, uint8_t yStride, uint8_t cStride)
+{
+  // Luma only, the Y samples are the output
+  if (luma)
+  {
+    uint8_t *out = (uint8_t *)pixels;
+    for (uint16_t py = 0; py < h; py++)
+    {
+      memcpy(out, yBuf + py * yStride, w);
+      out += w;
+    }
+    return;
+  }
+
+  if (comps == 1)
+  {
+    if (rgb332)
+    {
+      uint8_t *out = (uint8_t *)pixels;
+      for (uint16_t py = 0; py < h; py++)
+      {
+        const uint8_t *yp = yBuf + py * yStride;
+        for (uint16_t px = 0; px < w; px++) *out++ = grayLut[yp[px]];
+      }
+    }
+    else
+    {
+      uint16_t *out = pixels;
+      for (uint16_t py = 0; py < h; py++)
+      {
+        const uint8_t *yp = yBuf + py * yStride;
+        for (uint16_t px = 0; px < w; px++) *out++ = grayLut[yp[px]];
+      }
+    }
+    return;
+  }
+
+  uint8_t hShift = hMax - 1;
+  uint8_t vShift = vMax - 1;
+
+  // Chroma terms for each chroma sample used
+  int16_t rAdd[64], gAdd[64], bAdd[64];
+  uint8_t cw = (w + (1 << hShift) - 1) >> hShift;
+  uint8_t ch = (h + (1 << vShift) - 1) >> vShift;
+  for (uint8_t cy = 0; cy < ch; cy++)
+  {
+    for (uint8_t cx = 0; cx < cw; cx++)
+    {
+      uint8_t i = cy * cStride + cx;
+      int32_t cb = cbBuf[i] - 128;
+      int32_t cr = crBuf[i] - 128;
+      rAdd[i] = ( 91881 * cr + 32768) >> 16;
+      gAdd[i] = (-22554 * cb - 46802 * cr + 32768) >> 16;
+      bAdd[i] = (116130 * cb + 32768) >> 16;
+    }
+  }
+
+  if (rgb332)
+  {
+    uint8_t *out = (uint8_t *)pixels;
+    for (uint16_t py = 0; py < h; py++)
+    {
+      const uint8_t *yp = yBuf + py * yStride;
+      uint8_t row = (py >> vShift) * cStride;
+      for (uint16_t px = 0; px < w; px++)
+      {
+        uint8_t i = row + (px >> hShift);
+        int32_t y = yp[px];
+        uint8_t r = fjpgClamp(y + rAdd[i]);
+        uint8_t g = fjpgClamp(y + gAdd[i]);
+        uint8_t b = fjpgClamp(y + bAdd[i]);
+        *out++ = (r & 0xE0) | ((g & 0xE0) >> 3) | (b >> 6);
+      }
+    }
+    return;
+  }
+
+  uint16_t *out = pixels;
+  for (uint16_t py = 0; py < h; py++)
+  {
+    const uint8_t *yp = yBuf + py * yStride;
+    uint8_t row = (py >> vShift) * cStride;
+    for (uint16_t px = 0; px < w; px++)
+    {
+      uint8_t i = row + (px >> hShift);
+      int32_t y = yp[px];
+      uint8_t r = fjpgClamp(y + rAdd[i]);
+      uint8_t g = fjpgClamp(y + gAdd[i]);
+      uint8_t b = fjpgClamp(y + bAdd[i]);
+      *out++ = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+  }
+
+  // Panel byte order, done as a separate pass to keep the loop above branch free
+  if (swapBytes)
+  {
+    for (uint16_t i = 0; i < w * h; i++) pixels[i] = (pixels[i] >> 8) | (pixels[i] << 8);
+  }
+}
+
+/***************************************************************************************
+** Function name:           readDQT
+** Description:             read quantisation tables, AAN scaling them
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::readDQT(void)
+{
+  uint16_t len;
+  if (!readWord(&len)) return FJPG_INPUT;
+  int32_t remaining = len - 2;
+
+  while (remaining > 0)
+  {
+    uint8_t pt = readByte();
+    uint8_t precision = pt >> 4;
+    uint8_t table = pt & 0x0F;
+    if (table > 3 || precision > 1) return FJPG_FORMAT;
+
+    for (uint8_t k = 0; k < 64; k++)
+    {
+      uint32_t v = readByte();
+      if (precision) v = (v << 8) | readByte();
+      qt[table][k] = (v * fjpgAanScales[fjpgZigzag[k]] + (1 << 11)) >> 12;
+    }
+    if (inEnd) return FJPG_INPUT;
+
+    qtMask |= 1 << table;
+    remaining -= 1 + (precision ? 128 : 64);
+  }
+  return FJPG_OK;
+}
+
+/***************************************************************************************
+** Function name:           readDHT
+** Description:             read Huffman tables
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::readDHT(void)
+{
+  uint16_t len;
+  if (!readWord(&len)) return FJPG_INPUT;
+  int32_t remaining = len - 2;
+
+  while (remaining > 0)
+  {
+    uint8_t ct = readByte();
+    uint8_t cls = ct >> 4;
+    uint8_t table = ct & 0x0F;
+    if (cls > 1) return FJPG_FORMAT;
+    if (table > 1) return FJPG_UNSUPPORTED; // Baseline uses tables 0 and 1 only
+
+    uint8_t counts[16];
+    uint16_t total = 0;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+      counts[i] = readByte();
+      total += counts[i];
+    }
+    if (total > 256) return FJPG_FORMAT;
+
+    fjpg_huff_t *h = &huff[cls][table];
+    for (uint16_t i = 0; i < total; i++) h->symbols[i] = readByte();
+    if (inEnd) return FJPG_INPUT;
+
+    if (!fjpgBuildHuff(h, counts)) return FJPG_FORMAT;
+    if (cls) fjpgBuildFastAc(h, fastAc[table]);
+
+    huffMask |= 1 << (cls * 2 + table);
+    remaining -= 17 + total;
+  }
+  return FJPG_OK;
+}
+
+/***************************************************************************************
+** Function name:           readSOF
+** Description:             read the frame header
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::readSOF(void)
+{
+  uint16_t len;
+  if (!readWord(&len)) return FJPG_INPUT;
+
+  uint8_t precision = readByte();
+  if (!readWord(&height) || !readWord(&width)) return FJPG_INPUT;
+  comps = readByte();
+
+  if (precision != 8) return FJPG_UNSUPPORTED;
+  if (!width || !height) return FJPG_UNSUPPORTED; // Height set by a DNL marker
+  if (comps != 1 && comps != 3) return FJPG_UNSUPPORTED;
+
+  for (uint8_t i = 0; i < comps; i++)
+  {
+    comp[i].id = readByte();
+    uint8_t hv = readByte();
+    comp[i].h = hv >> 4;
+    comp[i].v = hv & 0x0F;
+    comp[i].qt = readByte() & 0x03;
+  }
+  if (inEnd) return FJPG_INPUT;
+
+  if (comps == 1)
+  {
+    // A single component scan is not interleaved, each MCU is one block
+    hMax = vMax = 1;
+  }
+  else
+  {
+    // Luma 1x1, 2x1, 1x2 or 2x2 with 1x1 chroma (4:4:4, 4:2:2, 4:4:0 and 4:2:0)
+    hMax = comp[0].h;
+    vMax = comp[0].v;
+    if (hMax < 1 || hMax > 2 || vMax < 1 || vMax > 2) return FJPG_UNSUPPORTED;
+    for (uint8_t i = 1; i < 3; i++)
+    {
+      if (comp[i].h != 1 || comp[i].v != 1) return FJPG_UNSUPPORTED;
+    }
+  }
+
+  mcuWidth   = 8 * hMax;
+  mcuHeight  = 8 * vMax;
+  mcusPerRow = (width  + mcuWidth  - 1) / mcuWidth;
+  mcusPerCol = (height + mcuHeight - 1) / mcuHeight;
+
+  if (len > 8 + 3 * comps && !skip(len - 8 - 3 * comps)) return FJPG_INPUT;
+  return FJPG_OK;
+}
+
+/***************************************************************************************
+** Function name:           readSOS
+** Description:             read the scan header
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::readSOS(void)
+{
+  uint16_t len;
+  if (!readWord(&len)) return FJPG_INPUT;
+  if (!comps) return FJPG_FORMAT; // No frame header
+
+  uint8_t n = readByte();
+  if (n != comps) return FJPG_UNSUPPORTED; // Separate component scans
+
+  for (uint8_t i = 0; i < n; i++)
+  {
+    uint8_t id = readByte();
+    uint8_t tables = readByte();
+    uint8_t c = 0;
+    while (c < comps && comp[c].id != id) c++;
+    if (c == comps) return FJPG_FORMAT;
+
+    comp[c].dc = tables >> 4;
+    comp[c].ac = tables & 0x0F;
+    if (comp[c].dc > 1 || comp[c].ac > 1) return FJPG_UNSUPPORTED;
+    if (!(huffMask & (1 << comp[c].dc)) || !(huffMask & (4 << comp[c].ac))) return FJPG_FORMAT;
+    if (!(qtMask & (1 << comp[c].qt))) return FJPG_FORMAT;
+    comp[c].pred = 0;
+  }
+
+  // Spectral selection and successive approximation, fixed for sequential Jpegs
+  uint8_t ss = readByte();
+  uint8_t se = readByte();
+  uint8_t a  = readByte();
+  if (inEnd) return FJPG_INPUT;
+  if (ss != 0 || se != 63 || a != 0) return FJPG_UNSUPPORTED;
+
+  if (len > 6 + 2 * n && !skip(len - 6 - 2 * n)) return FJPG_INPUT;
+  return FJPG_OK;
+}
+
+/***************************************************************************************
+** Function name:           prepare
+** Description:             reset the decoder and read the headers up to the image data
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::prepare(fjpg_input_t input, void *src)
+{
+  _input = input;
+  _src = src;
+  inPos = inLen = 0;
+  inCount = 0;
+  inEnd = false;
+  bitBuf = 0;
+  bitCount = 0;
+  marker = 0;
+  qtMask = huffMask = 0;
+
+  width = height = 0;
+  comps = 0;
+  mcuWidth = mcuHeight = 0;
+  mcusPerRow = mcusPerCol = 0;
+  restartInterval = 0;
+  swapBytes = false;
+  rgb332 = false;
+  luma = false;
+  setClip(0, 0, 0x7FFF, 0x7FFF);
+
+  if (readByte() != 0xFF || readByte() != 0xD8) return inEnd ? FJPG_INPUT : FJPG_FORMAT;
+
+  for (;;)
+  {
+    // Skip anything up to the next marker, then any fill bytes
+    uint8_t m = readByte();
+    while (m != 0xFF && !inEnd) m = readByte();
+    while (m == 0xFF && !inEnd) m = readByte();
+    if (inEnd) return FJPG_INPUT;
+
+    fjpg_result_t result = FJPG_OK;
+    uint16_t len;
+
+    switch (m)
+    {
+      case 0xC0: // Baseline
+      case 0xC1: // Extended sequential, Huffman
+        result = readSOF();
+        break;
+      case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7: // Progressive, lossless, hierarchical
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF: // Arithmetic coded
+        return FJPG_UNSUPPORTED;
+      case 0xC4:
+        result = readDHT();
+        break;
+      case 0xDB:
+        result = readDQT();
+        break;
+      case 0xDD: // Restart interval
+        if (!readWord(&len) || !readWord(&restartInterval)) return FJPG_INPUT;
+        if (len > 4 && !skip(len - 4)) return FJPG_INPUT;
+        break;
+      case 0xDA:
+        result = readSOS();
+        dataOffset = inCount - (inLen - inPos); // Where decodeParallel() finds the image data
+        return result;
+      case 0xD9: // End of image before any image data
+        return FJPG_FORMAT;
+      default:   // APPn, COM and others are skipped
+        if (!readWord(&len)) return FJPG_INPUT;
+        if (len < 2 || !skip(len - 2)) return FJPG_INPUT;
+        break;
+    }
+
+    if (result != FJPG_OK) return result;
+  }
+}
+
+/***************************************************************************************
+** Function name:           setClip
+** Description:             set the window of MCUs to draw, in scaled pixels
+***************************************************************************************/
+void TFT_eFEX_Jpeg::setClip(int16_t x, int16_t y, uint16_t w, uint16_t h)
+{
+  clipX = x;
+  clipY = y;
+  clipW = (w > 0x7FFF) ? 0x7FFF : w;
+  clipH = (h > 0x7FFF) ? 0x7FFF : h;
+}
+
+/***************************************************************************************
+** Function name:           decode
+** Description:             decode the image, passing the pixels of each MCU to output()
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::decode(fjpg_output_t output, void *dev, uint8_t scale)
+{
+  if (!comps) return FJPG_FORMAT; // prepare() failed or was not called
+  if (scale > 3) return FJPG_PARAMETER;
+
+  if (comps == 1) grayTable();
+
+  return decodeMcus(0, (uint32_t)mcusPerRow * mcusPerCol, scale, output, dev);
+}
+
+/***************************************************************************************
+** Function name:           decodeMcus
+** Description:             decode MCUs first to last - 1, passing the pixels to output()
+***************************************************************************************/
+// first must be 0 or the first MCU after a restart marker, with the input positioned there
+fjpg_result_t TFT_eFEX_Jpeg::decodeMcus(uint32_t first, uint32_t last, uint8_t scale, fjpg_output_t output, void *dev)
+{
+  // Scaled image and MCU sizes
+  uint16_t outWidth  = (width  + (1 << scale) - 1) >> scale;
+  uint16_t outHeight = (height + (1 << scale) - 1) >> scale;
+  uint8_t  mcuW = mcuWidth >> scale;
+  uint8_t  mcuH = mcuHeight >> scale;
+  uint8_t  cStride = 8 >> scale;
+
+  int32_t  clipRight  = (int32_t)clipX + clipW;
+  int32_t  clipBottom = (int32_t)clipY + clipH;
+
+  uint16_t mx = first % mcusPerRow;
+  uint16_t my = first / mcusPerRow;
+
+  for (uint32_t mcu = first; mcu < last; mcu++)
+  {
+    int16_t y = my * mcuH;
+
+    // Nothing more to draw below the clip window
+    if (y >= clipBottom) break;
+
+    if (restartInterval && (mcu != first) && !(mcu % restartInterval))
+    {
+      if (!restart()) return FJPG_FORMAT;
+    }
+
+    int16_t x = mx * mcuW;
+    uint8_t w = (outWidth  - x < mcuW) ? outWidth  - x : mcuW;
+    uint8_t h = (outHeight - y < mcuH) ? outHeight - y : mcuH;
+
+    if (++mx == mcusPerRow)
+    {
+      mx = 0;
+      my++;
+    }
+
+    // MCUs outside the clip window are only entropy decoded
+    bool visible = (x < clipRight) && (x + w > clipX) && (y + h > clipY);
+    bool dcOnly = !visible || (scale == 3);
+    bool acZero;
+
+    // Luma blocks, left to right then top to bottom
+    for (uint8_t by = 0; by < vMax; by++)
+    {
+      for (uint8_t bx = 0; bx < hMax; bx++)
+      {
+        if (!decodeBlock(&comp[0], dcOnly, &acZero)) return FJPG_FORMAT;
+        if (!visible) continue;
+        if (scale == 3) yBuf[by * hMax + bx] = fjpgDcValue(coef[0]);
+        else
+        {
+          uint8_t *out = yBuf + by * 8 * mcuWidth + bx * 8;
+          if (acZero)
+          {
+            uint8_t v = fjpgDcValue(coef[0]);
+            for (uint8_t i = 0; i < 8; i++) memset(out + i * mcuWidth, v, 8);
+          }
+          else idct(out, mcuWidth);
+        }
+      }
+    }
+
+    // Chroma blocks, only entropy decoded for luma output
+    for (uint8_t c = 1; c < comps; c++)
+    {
+      uint8_t *out = (c == 1) ? cbBuf : crBuf;
+      if (!decodeBlock(&comp[c], dcOnly || luma, &acZero)) return FJPG_FORMAT;
+      if (!visible || luma) continue;
+      if (scale == 3) out[0] = fjpgDcValue(coef[0]);
+      else if (acZero) memset(out, fjpgDcValue(coef[0]), 64);
+      else idct(out, 8);
+    }
+
+    if (!visible) continue;
+
+    if (scale && scale < 3)
+    {
+      shrink(yBuf, mcuWidth, mcuWidth, mcuHeight, scale);
+      if ((comps == 3) && !luma)
+      {
+        shrink(cbBuf, 8, 8, 8, scale);
+        shrink(crBuf, 8, 8, 8, scale);
+      }
+    }
+
+    convert(w, h, mcuW, cStride);
+    if (!output(dev, x, y, w, h, pixels)) return FJPG_INTERRUPTED;
+  }
+
+  return FJPG_OK;
+}
+
+/***************************************************************************************
+** Function name:           fjpgArrayInput
+** Description:             input function for a strip, reads the image held in memory
+***************************************************************************************/
+static uint32_t fjpgArrayInput(void *src, uint8_t *buf, uint32_t len)
+{
+  fjpg_strip_t *strip = (fjpg_strip_t *)src;
+  if (len > strip->len) len = strip->len;
+  if (buf) memcpy(buf, strip->data, len);
+  strip->data += len;
+  strip->len  -= len;
+  return len;
+}
+
+/***************************************************************************************
+** Function name:           fjpgStripOutput
+** Description:             output function for a strip, copies each MCU into the strip
+***************************************************************************************/
+static bool fjpgStripOutput(void *dev, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *pixels)
+{
+  fjpg_strip_t *strip = (fjpg_strip_t *)dev;
+  uint8_t  bytes = (strip->jpeg->rgb332 || strip->jpeg->luma) ? 1 : 2; // Bytes per pixel
+  uint8_t *out = (uint8_t *)strip->buf + ((y - strip->y) * strip->w + (x - strip->x)) * bytes;
+  uint8_t *in  = (uint8_t *)pixels;
+  for (uint16_t row = 0; row < h; row++)
+  {
+    memcpy(out, in, w * bytes);
+    out += strip->w * bytes;
+    in  += w * bytes;
+  }
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           decodeStrip
+** Description:             decode the MCUs of one strip into the strip buffer
+***************************************************************************************/
+fjpg_result_t TFT_eFEX_Jpeg::decodeStrip(fjpg_strip_t *strip)
+{
+  // Each strip starts after a restart marker, so it is decoded from a clean state
+  _input = fjpgArrayInput;
+  _src = strip;
+  inPos = inLen = 0;
+  inEnd = false;
+  bitBuf = 0;
+  bitCount = 0;
+  marker = 0;
+  comp[0].pred = comp[1].pred = comp[2].pred = 0;
+
+  return decodeMcus(strip->first, strip->last, strip->scale, fjpgStripOutput, strip);
+}
+
+#ifdef FJPG_THREADS
+/***************************************************************************************
+** Function name:           signalInit, signalGive, signalTake, signalFree
+** Description:             binary signal, a FreeRTOS semaphore or a pthread condition
+***************************************************************************************/
+static bool signalInit(fjpg_signal_t *signal)
+{
+#if defined (ESP32)
+  *signal = xSemaphoreCreateBinary();
+  return (*signal != NULL);
+#else
+  signal->set = false;
+  if (pthread_mutex_init(&signal->mutex, NULL)) return false;
+  if (pthread_cond_init(&signal->cond, NULL) == 0) return true;
+  pthread_mutex_destroy(&signal->mutex);
+  return false;
+#endif
+}
+
+static void signalGive(fjpg_signal_t *signal)
+{
+#if defined (ESP32)
+  xSemaphoreGive(*signal);
+#else
+  pthread_mutex_lock(&signal->mutex);
+  signal->set = true;
+  pthread_cond_signal(&signal->cond);
+  pthread_mutex_unlock(&signal->mutex);
+#endif
+}
+
+static void signalTake(fjpg_signal_t *signal)
+{
+#if defined (ESP32)
+  xSemaphoreTake(*signal, portMAX_DELAY);
+#else
+  pthread_mutex_lock(&signal->mutex);
+  while (!signal->set) pthread_cond_wait(&signal->cond, &signal->mutex);
+  signal->set = false;
+  pthread_mutex_unlock(&signal->mutex);
+#endif
+}
+
+static void signalFree(fjpg_signal_t *signal)
+{
+#if defined (ESP32)
+  vSemaphoreDelete(*signal);
+#else
+  pthread_cond_destroy(&signal->cond);
+  pthread_mutex_destroy(&signal->mutex);
+#endif
+}
+#endif
+
+/***************************************************************************************
+** Function name:           decodeParallel
+** Description:             decode the strips between restart markers on two cores
+***************************************************************************************/
+// The image is cut into strips of whole MCU rows that start at a restart marker. One
+// worker task (thread on a PC) is started on the other core for the whole image and
+// decodes the odd strips, taking them from a two slot queue. This task decodes the
+// even strips and passes every strip to output() in order, so the worker decodes the
+// next odd strip while this core pushes. Falls back to decode() if that is not possible
+fjpg_result_t TFT_eFEX_Jpeg::decodeParallel(const uint8_t *data, uint32_t len, fjpg_output_t output, void *dev, uint8_t scale)
+{
+  if (!comps) return FJPG_FORMAT; // prepare() failed or was not called
+  if (scale > 3) return FJPG_PARAMETER;
+
+  if (comps == 1) grayTable(); // Before the table is copied to the second decoder
+
+#ifndef FJPG_THREADS
+  (void)data; (void)len;
+  return decode(output, dev, scale);
+#else
+  if (!restartInterval || (dataOffset >= len)) return decode(output, dev, scale);
+
+  // Fewest MCU rows per strip that hold a whole number of restart intervals
+  uint16_t a = restartInterval, b = mcusPerRow;
+  while (b) { uint16_t t = a % b; a = b; b = t; }
+  uint32_t rows = restartInterval / a;
+  uint32_t strips = (mcusPerCol + rows - 1) / rows;
+  if (strips < 2) return decode(output, dev, scale);
+
+  uint16_t outWidth  = (width  + (1 << scale) - 1) >> scale;
+  uint16_t outHeight = (height + (1 << scale) - 1) >> scale;
+  uint8_t  mcuW = mcuWidth >> scale;
+  uint8_t  mcuH = mcuHeight >> scale;
+
+  // Strips only need to be as wide as the MCU columns in the clip window
+  int32_t  clipRight  = (int32_t)clipX + clipW;
+  int32_t  clipBottom = (int32_t)clipY + clipH;
+  uint32_t colFirst = (clipX > 0) ? clipX / mcuW : 0;
+  uint32_t colEnd   = (clipRight + mcuW - 1) / mcuW;
+  if (colEnd > mcusPerRow) colEnd = mcusPerRow;
+  if (colEnd <= colFirst) return FJPG_OK;
+  uint16_t stripX = colFirst * mcuW;
+  uint16_t stripW = ((colEnd * mcuW > outWidth) ? outWidth : colEnd * mcuW) - stripX;
+  uint16_t stripH = rows * mcuH;
+
+  uint32_t stripSize = (uint32_t)stripW * stripH * ((rgb332 || luma) ? 1 : 2);
+  if (stripSize > FJPG_STRIP_BUFFER) return decode(output, dev, scale);
+
+  // Strips that overlap the clip window
+  uint32_t sFirst = (clipY > 0) ? clipY / stripH : 0;
+  uint32_t sEnd   = (clipBottom + stripH - 1) / stripH;
+  if (sEnd > strips) sEnd = strips;
+  if (sEnd <= sFirst) return FJPG_OK;
+
+  // Find where each strip starts, just after the restart marker in front of its first MCU
+  uint32_t *start = (uint32_t *)malloc((sEnd - sFirst) * sizeof(uint32_t));
+  if (!start) return decode(output, dev, scale);
+
+  uint32_t pos = dataOffset; // data[pos] is the start of restart interval rst
+  uint32_t rst = 0;
+  for (uint32_t s = sFirst; s < sEnd; s++)
+  {
+    uint32_t target = s * rows * mcusPerRow / restartInterval;
+    while ((rst < target) && (pos + 1 < len))
+    {
+      if ((data[pos] == 0xFF) && ((data[pos + 1] & 0xF8) == 0xD0)) rst++;
+      pos++;
+    }
+    if (rst < target)
+    {
+      free(start);
+      return FJPG_FORMAT; // Missing restart markers
+    }
+    if (target) pos++; // Skip the marker code
+    start[s - sFirst] = pos;
+  }
+
+  // Strip buffers for this task and the worker's two slots, plus a second decoder
+  // for the worker copied from this one so it has the same tables and clip window
+  TFT_eFEX_Jpeg *helper = nullptr;
+  uint16_t *buf[3] = { nullptr, nullptr, nullptr };
+  buf[0] = (uint16_t *)malloc(stripSize);
+  if (!buf[0])
+  {
+    free(start);
+    return decode(output, dev, scale);
+  }
+  if (sEnd - sFirst > 1)
+  {
+    helper = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+    buf[1] = (uint16_t *)malloc(stripSize);
+    buf[2] = (uint16_t *)malloc(stripSize);
+  }
+  if (helper) memcpy((void *)helper, (const void *)this, sizeof(TFT_eFEX_Jpeg));
+
+  auto setup = [&](fjpg_strip_t *st, uint32_t s) {
+    uint32_t first = s * rows * mcusPerRow;
+    st->data  = data + start[s - sFirst];
+    st->len   = len - start[s - sFirst];
+    st->first = first;
+    st->last  = first + rows * mcusPerRow;
+    if (st->last > (uint32_t)mcusPerRow * mcusPerCol) st->last = (uint32_t)mcusPerRow * mcusPerCol;
+    st->scale = scale;
+    st->x     = stripX;
+    st->y     = s * stripH;
+    st->w     = stripW;
+    st->h     = (outHeight - st->y < stripH) ? outHeight - st->y : stripH;
+  };
+
+  fjpg_worker_t worker;
+  worker.slots = buf[2] ? 2 : 1;
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    worker.slot[i].jpeg = helper;
+    worker.slot[i].buf  = buf[1 + i];
+  }
+  // With no worker (one strip, not enough RAM or no task) this task decodes every strip
+  bool threaded = helper && buf[1] && startWorker(&worker);
+
+  fjpg_strip_t mine;
+  mine.jpeg = this;
+  mine.buf  = buf[0];
+
+  fjpg_result_t result = FJPG_OK;
+  uint32_t next = sFirst + 1;          // Next strip to queue for the worker
+  uint32_t queued = 0, collected = 0;  // Strips queued for and collected from the worker
+
+  for (uint32_t s = sFirst; (s < sEnd) && (result == FJPG_OK); s++)
+  {
+    // Keep the worker's queue full so it is never waiting while this core pushes
+    while (threaded && (queued - collected < worker.slots) && (next < sEnd))
+    {
+      fjpg_strip_t *st = &worker.slot[queued++ % worker.slots];
+      setup(st, next);
+      signalGive(&st->ready);
+      next += 2;
+    }
+
+    fjpg_strip_t *st;
+    if (threaded && ((s - sFirst) & 1))
+    {
+      st = &worker.slot[collected % worker.slots];
+      signalTake(&st->done);
+      result = st->result;
+    }
+    else
+    {
+      st = &mine;
+      setup(st, s);
+      result = decodeStrip(st);
+    }
+
+    if (result == FJPG_OK)
+    {
+      if (!output(dev, st->x, st->y, st->w, st->h, st->buf)) result = FJPG_INTERRUPTED;
+    }
+    if (st != &mine) collected++; // Its slot can be queued again
+  }
+
+  if (threaded) stopWorker(&worker, queued, collected);
+
+  free(helper);
+  free(buf[0]);
+  free(buf[1]);
+  free(buf[2]);
+  free(start);
+
+  return result;
+#endif
+}
+
+#ifdef FJPG_THREADS
+/***************************************************************************************
+** Function name:           startWorker
+** Description:             start the strip decoding task on the other core (or a thread)
+***************************************************************************************/
+bool TFT_eFEX_Jpeg::startWorker(fjpg_worker_t *worker)
+{
+  // Two signals per slot
+  fjpg_signal_t *signal[4] = { &worker->slot[0].ready, &worker->slot[0].done, &worker->slot[1].ready, &worker->slot[1].done };
+  uint8_t n = 0;
+  while ((n < 2 * worker->slots) && signalInit(signal[n])) n++;
+
+  bool started = false;
+  if (n == 2 * worker->slots)
+  {
+#if defined (ESP32)
+    // Same priority as this task, pinned to the other core
+    started = (xTaskCreatePinnedToCore(workerTask, "fjpgStrip", FJPG_STRIP_STACK, worker, uxTaskPriorityGet(NULL),
+                                       NULL, xPortGetCoreID() ^ 1) == pdPASS);
+#else
+    started = (pthread_create(&worker->thread, NULL, [](void *param) -> void * { workerTask(param); return NULL; }, worker) == 0);
+#endif
+  }
+
+  if (!started) while (n) signalFree(signal[--n]);
+  return started;
+}
+
+/***************************************************************************************
+** Function name:           workerTask
+** Description:             task (or thread) that decodes the strips queued in its slots
+***************************************************************************************/
+void TFT_eFEX_Jpeg::workerTask(void *param)
+{
+  fjpg_worker_t *worker = (fjpg_worker_t *)param;
+
+  for (uint8_t i = 0; ; i = (i + 1) % worker->slots)
+  {
+    fjpg_strip_t *strip = &worker->slot[i];
+    signalTake(&strip->ready);
+    bool stop = (strip->jpeg == nullptr);
+    if (!stop) strip->result = strip->jpeg->decodeStrip(strip);
+    signalGive(&strip->done);
+    if (stop) break;
+  }
+
+#if defined (ESP32)
+  vTaskDelete(NULL);
+#endif
+}
+
+/***************************************************************************************
+** Function name:           stopWorker
+** Description:             wait for the queued strips, then stop the worker
+***************************************************************************************/
+// queued and collected are the number of strips put in and taken out of the slots
+void TFT_eFEX_Jpeg::stopWorker(fjpg_worker_t *worker, uint32_t queued, uint32_t collected)
+{
+  // Strips still queued if decoding stopped early
+  while (collected < queued) signalTake(&worker->slot[collected++ % worker->slots].done);
+
+  // An empty strip in the next slot stops the worker
+  fjpg_strip_t *strip = &worker->slot[queued % worker->slots];
+  strip->jpeg = nullptr;
+  signalGive(&strip->ready);
+  signalTake(&strip->done);
+#if !defined (ESP32)
+  pthread_join(worker->thread, NULL);
+#endif
+
+  for (uint8_t i = 0; i < worker->slots; i++)
+  {
+    signalFree(&worker->slot[i].ready);
+    signalFree(&worker->slot[i].done);
+  }
+}
+#endif
@@ -0,0 +1,218 @@
+/***************************************************************************************
+// Baseline Jpeg decoder bundled with TFT_eFEX
+
+// Decodes baseline (and 8 bit extended sequential) Huffman coded Jpegs with 1 or 3
+// components straight to 16 bit 565 pixels, one Minimum Coding Unit (MCU) at a time.
+// It is plain C++ with no Arduino dependencies so it builds on a PC and produces the
+// same pixels there as on the ESP8266 and ESP32 (all arithmetic is integer).
+
+// Speed comes from:
+//   Huffman codes up to FJPG_LOOKUP_BITS long decoded with one table lookup, with
+//   small AC coefficients decoded (code + value bits) in the same lookup
+//   A fixed point AAN IDCT with the AAN scale factors folded into the dequantisation
+//   IDCT skipped for blocks with only a DC coefficient, and for rows and columns with
+//   no AC coefficients
+//   MCUs outside the clip window are entropy decoded only (no IDCT or conversion) and
+//   decoding stops below the window
+//   YCbCr converted straight to 565, chroma terms worked out once per chroma sample
+//   Grayscale images skip all chroma work, Y is converted with a 256 entry lookup table
+//   8 bit RGB332 output so 8 bit Sprites can be written directly
+//   8 bit luma output with no colour conversion at all, for dithering to ePaper
+//   Images with restart markers can be decoded on both cores of an ESP32 (two threads
+//   on a PC) with decodeParallel()
+
+// Usage:
+//   TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg)); // ~10 kbytes
+//   if (jpeg->prepare(myInput, &mySource) == FJPG_OK) jpeg->decode(myOutput, &myDevice);
+//   free(jpeg);
+***************************************************************************************/
+
+#ifndef _TFT_eFEX_JpegH_
+#define _TFT_eFEX_JpegH_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FJPG_INPUT_BUFFER 512 // Bytes read from the input function at a time
+#define FJPG_LOOKUP_BITS    9 // Huffman codes up to this length take one table lookup
+#define FJPG_STRIP_BUFFER 32768 // Largest strip buffer decodeParallel() will allocate (three are used)
+#define FJPG_STRIP_STACK   4096 // Stack for the ESP32 strip decoding task
+
+// decodeParallel() uses the second core of an ESP32, or a second thread on a PC
+#if defined (ESP32)
+  #include "freertos/FreeRTOS.h"
+  #include "freertos/task.h"
+  #include "freertos/semphr.h"
+  #if (portNUM_PROCESSORS > 1)
+    #define FJPG_THREADS
+  #endif
+#elif defined (__unix__) || defined (__APPLE__)
+  #include <pthread.h>
+  #define FJPG_THREADS
+#endif
+
+typedef enum {
+  FJPG_OK = 0,       // Succeeded
+  FJPG_INTERRUPTED,  // Stopped by the output function
+  FJPG_INPUT,        // Input function failed or the data ended early
+  FJPG_FORMAT,       // Not a Jpeg or bad data
+  FJPG_UNSUPPORTED,  // Progressive, arithmetic coded, 12 bit or unsupported sampling
+  FJPG_PARAMETER     // Bad parameter
+} fjpg_result_t;
+
+// Input function: copy len bytes into buf, or skip len bytes if buf is nullptr.
+// Returns the number of bytes read or skipped, less than len at the end of the data
+typedef uint32_t (*fjpg_input_t)(void *src, uint8_t *buf, uint32_t len);
+
+// Output function: w x h pixels of one MCU (or one strip for decodeParallel()), row by row,
+// at x,y in the (scaled) image. If rgb332 or luma is set pixels holds one byte per pixel, cast
+// it to uint8_t *. Return false to stop decoding
+typedef bool (*fjpg_output_t)(void *dev, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *pixels);
+
+// Huffman table
+typedef struct {
+  uint16_t lookup[1 << FJPG_LOOKUP_BITS]; // (length << 8) | symbol, 0 for longer codes
+  int32_t  maxCode[17];                   // Largest code of each length, -1 if none
+  int32_t  valOffset[17];                 // Code to symbol index offset for each length
+  uint8_t  symbols[256];
+} fjpg_huff_t;
+
+// Component
+typedef struct {
+  uint8_t id;
+  uint8_t h, v;      // Sampling factors
+  uint8_t qt;        // Quantisation table
+  uint8_t dc, ac;    // Huffman tables
+  int32_t pred;      // DC prediction
+} fjpg_comp_t;
+
+#ifdef FJPG_THREADS
+// Binary signal between decodeParallel() and its worker task (thread on a PC)
+#if defined (ESP32)
+typedef SemaphoreHandle_t fjpg_signal_t;
+#else
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+  bool set;
+} fjpg_signal_t;
+#endif
+#endif
+
+// One strip of MCU rows for decodeParallel()
+typedef struct {
+  class TFT_eFEX_Jpeg *jpeg;   // Decoder used for the strip
+  const uint8_t *data;         // Image data from the restart marker on
+  uint32_t len;
+  uint32_t first, last;        // MCUs in the strip
+  uint8_t  scale;
+  int16_t  x, y;               // Position and size in the scaled image
+  uint16_t w, h;
+  uint16_t *buf;               // Strip buffer, w pixels per line
+  fjpg_result_t result;
+#ifdef FJPG_THREADS
+  fjpg_signal_t ready;         // Strip queued for the worker (jpeg == nullptr stops it)
+  fjpg_signal_t done;          // Strip decoded by the worker
+#endif
+} fjpg_strip_t;
+
+#ifdef FJPG_THREADS
+// Worker that decodes every other strip on the other core for the whole image. Its
+// slots are a queue: strips are put in and taken out in turn, so while one strip is
+// pushed by decodeParallel() the worker can already be decoding the next
+typedef struct {
+  fjpg_strip_t slot[2];
+  uint8_t      slots;          // 2, or 1 if there was not enough RAM for a second strip buffer
+#if !defined (ESP32)
+  pthread_t    thread;
+#endif
+} fjpg_worker_t;
+#endif
+
+class TFT_eFEX_Jpeg {
+
+ public:
+
+           // Read the headers up to the image data, must be called first as it resets everything
+  fjpg_result_t prepare(fjpg_input_t input, void *src);
+
+           // Decode the image, scale 0-3 gives 1/1, 1/2, 1/4 or 1/8 size (1/8 only decodes the DC coefficients)
+  fjpg_result_t decode(fjpg_output_t output, void *dev, uint8_t scale = 0);
+
+           // As decode() but images with restart markers are decoded in strips on two cores, call after prepare()
+           // data and len must be the whole image passed to prepare(), held in RAM or memory mapped FLASH.
+           // Falls back to decode() if there are no restart markers, one core or not enough RAM
+  fjpg_result_t decodeParallel(const uint8_t *data, uint32_t len, fjpg_output_t output, void *dev, uint8_t scale = 0);
+
+           // Only draw MCUs that overlap this window (in scaled pixels), call after prepare()
+  void     setClip(int16_t x, int16_t y, uint16_t w, uint16_t h);
+
+  uint16_t width, height;          // Image size in pixels
+  uint8_t  comps;                  // 1 = grayscale, 3 = YCbCr colour
+  uint8_t  mcuWidth, mcuHeight;    // MCU size in pixels at 1/1 scale
+  uint16_t mcusPerRow, mcusPerCol;
+  uint16_t restartInterval;        // MCUs between restart markers, 0 if none
+  bool     swapBytes;              // Output in panel byte order (MSB first), false after prepare()
+  bool     rgb332;                 // Output 8 bit RGB332 pixels for 8 bit Sprites, false after prepare()
+  bool     luma;                   // Output 8 bit luma (Y) only, e.g. for dithering, false after prepare()
+
+ private:
+
+  fjpg_input_t  _input;
+  void         *_src;
+
+  // Input buffer
+  uint8_t  inBuf[FJPG_INPUT_BUFFER];
+  uint16_t inPos, inLen;
+  bool     inEnd;
+  uint32_t inCount;                // Bytes taken from the input function
+  uint32_t dataOffset;             // Start of the image data after the headers
+
+  // Entropy decoder bit buffer, bits are left aligned
+  uint32_t bitBuf;
+  int8_t   bitCount;
+  uint8_t  marker;                 // Marker found in the image data, 0 if none
+
+  int32_t     qt[4][64];           // Dequantisation multipliers in zigzag order, AAN scaled
+  fjpg_huff_t huff[2][2];          // [DC, AC][table]
+  int16_t     fastAc[2][1 << FJPG_LOOKUP_BITS]; // (value << 8) | (run << 4) | code + value length, 0 if too long
+  uint8_t     qtMask, huffMask;    // Tables defined so far
+  fjpg_comp_t comp[3];
+  uint8_t     hMax, vMax;
+
+  int16_t  clipX, clipY, clipW, clipH;
+
+  int32_t  coef[64];               // Dequantised block in natural order
+  uint8_t  yBuf[256];              // MCU samples, up to 16x16 luma
+  uint8_t  cbBuf[64], crBuf[64];
+  uint16_t pixels[256];
+  uint16_t grayLut[256];           // Y to pixel lookup for grayscale images
+
+  uint8_t  readByte(void);
+  bool     readWord(uint16_t *w);
+  bool     skip(uint32_t n);
+  void     fillBits(void);
+  int32_t  getBits(uint8_t n);
+  int16_t  decodeHuff(fjpg_huff_t *h);
+  bool     restart(void);
+  bool     decodeBlock(fjpg_comp_t *c, bool dcOnly, bool *acZero);
+  void     idct(uint8_t *out, uint8_t stride);
+  void     shrink(uint8_t *buf, uint8_t stride, uint8_t w, uint8_t h, uint8_t scale);
+  void     grayTable(void);
+  void     convert(uint16_t w, uint16_t h, uint8_t yStride, uint8_t cStride);
+
+  fjpg_result_t decodeMcus(uint32_t first, uint32_t last, uint8_t scale, fjpg_output_t output, void *dev);
+  fjpg_result_t decodeStrip(fjpg_strip_t *strip);
+#ifdef FJPG_THREADS
+  static bool startWorker(fjpg_worker_t *worker);
+  static void workerTask(void *param);
+  static void stopWorker(fjpg_worker_t *worker, uint32_t queued, uint32_t collected);
+#endif
+
+  fjpg_result_t readDQT(void);
+  fjpg_result_t readDHT(void);
+  fjpg_result_t readSOF(void);
+  fjpg_result_t readSOS(void);
+};
+
+#endif
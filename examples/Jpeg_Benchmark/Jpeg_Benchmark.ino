@@ -0,0 +1,185 @@
+/*====================================================================================
+
+       Benchmark the bundled TFT_eFEX jpeg decoder against the other decoders
+
+  ==================================================================================*/
+
+// The example images used to test this sketch can be found in the sketch
+// Data folder, press Ctrl+K to see this folder. Use the IDE "Tools" menu
+// "ESP32 Sketch Data Upload" (or ESP8266) option to upload the images to SPIFFS.
+
+// For each image this prints:
+//   the time the bundled decoder takes to decode the image without drawing it, plus
+//   a checksum of the decoded pixels
+//   the time drawJpeg() takes to decode and draw the image (bundled decoder)
+//   on ESP32 the time drawJpgFile() takes (ESP32 ROM native decoder)
+//   for images with restart markers, the time drawJpeg() takes to draw the image from
+//   RAM on one core and then on two cores (see setJpegParallel()). The example images
+//   have no restart markers, add a camera image to the list to try this
+//   the time JPEGDecoder takes to decode the image if USE_JPEGDECODER is defined
+
+// The checksums must match those printed by the PC program in the "host" folder of
+// this sketch, which decodes the same images with the same decoder source code.
+
+// Uncomment to include the JPEGDecoder library in the comparison, needs:
+// https://github.com/Bodmer/JPEGDecoder
+//#define USE_JPEGDECODER
+
+//====================================================================================
+//                                  Libraries
+//====================================================================================
+// Call up the SPIFFS FLASH filing system this is part of the ESP Core
+#define FS_NO_GLOBALS
+#include <FS.h>
+
+#ifdef ESP32
+#include "SPIFFS.h" // Needed for ESP32 only
+#endif
+
+#include <SPI.h>
+
+// https://github.com/Bodmer/TFT_eSPI
+#include <TFT_eSPI.h>                 // Hardware-specific library
+TFT_eSPI tft = TFT_eSPI();            // Invoke custom library
+
+// https://github.com/Bodmer/TFT_eFEX
+#include <TFT_eFEX.h>              // Include the extension graphics functions library
+TFT_eFEX  fex = TFT_eFEX(&tft);    // Create TFT_eFX object "efx" with pointer to "tft" object
+
+#ifdef USE_JPEGDECODER
+  #include <JPEGDecoder.h>
+#endif
+
+const char *images[] = { "/Baboon.jpg", "/BaboonL.jpg", "/EagleEye.jpg", "/Tiger.jpg" };
+
+//====================================================================================
+//                                    Setup
+//====================================================================================
+void setup()
+{
+  Serial.begin(250000);
+
+  delay(10);
+  Serial.println("\nJpeg decoder benchmark");
+
+  tft.begin();
+
+  tft.setRotation(0);  // 0 & 2 Portrait. 1 & 3 landscape
+
+  tft.fillScreen(TFT_BLACK);
+
+  if (!SPIFFS.begin()) {
+    Serial.println("SPIFFS initialisation failed!");
+    while (1) yield(); // Stay here twiddling thumbs waiting
+  }
+  Serial.println("\r\nInitialisation done.");
+}
+
+//====================================================================================
+//                                    Loop
+//====================================================================================
+void loop()
+{
+  for (uint8_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+    benchmark(images[i]);
+    delay(1000);
+  }
+
+  Serial.println();
+  while(1) yield(); // Stay here
+}
+
+//====================================================================================
+//                        Decoder input and output functions
+//====================================================================================
+uint32_t checksum;
+
+// Read from (or skip bytes in) a file
+uint32_t fileInput(void *src, uint8_t *buf, uint32_t len)
+{
+  fs::File *file = (fs::File *)src;
+  if (buf) return file->read(buf, len);
+  file->seek(len, fs::SeekCur);
+  return len;
+}
+
+// Add the pixels to the checksum instead of drawing them
+bool checksumOutput(void *dev, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *pixels)
+{
+  for (uint16_t i = 0; i < w * h; i++) checksum = (checksum ^ pixels[i]) * 16777619;
+  return true;
+}
+
+//====================================================================================
+//                             Time each decoder
+//====================================================================================
+void benchmark(const char *path)
+{
+  Serial.println(path);
+
+  // Bundled decoder only, no drawing
+  TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+  uint16_t restarts = 0;
+  if (jpeg) {
+    for (uint8_t scale = 0; scale < 4; scale += 3) {
+      fs::File file = SPIFFS.open(path, "r");
+      checksum = 2166136261;
+      uint32_t t = micros();
+      fjpg_result_t result = jpeg->prepare(fileInput, &file);
+      if (result == FJPG_OK) result = jpeg->decode(checksumOutput, nullptr, scale);
+      t = micros() - t;
+      restarts = jpeg->restartInterval;
+      file.close();
+      Serial.print("  Bundled decode 1/"); Serial.print(1 << scale);
+      Serial.print(" : "); Serial.print(t); Serial.print(" us, result "); Serial.print(result);
+      Serial.print(", checksum "); Serial.println(checksum, HEX);
+    }
+    free(jpeg);
+  }
+
+  image_stats_t stats;
+
+  // Bundled decoder drawing to the TFT
+  tft.fillScreen(TFT_BLACK);
+  fex.drawJpeg(path, 0, 0, nullptr, &stats);
+  Serial.print("  drawJpeg()    : "); Serial.print(stats.totalTime);
+  Serial.print(" us (push "); Serial.print(stats.pushTime); Serial.println(" us)");
+
+#ifdef ESP32
+  // ESP32 ROM decoder drawing to the TFT
+  tft.fillScreen(TFT_BLACK);
+  fex.drawJpgFile(SPIFFS, path, 0, 0, 0, 0, 0, 0, JPEG_DIV_NONE, &stats);
+  Serial.print("  drawJpgFile() : "); Serial.print(stats.totalTime);
+  Serial.print(" us (push "); Serial.print(stats.pushTime); Serial.println(" us)");
+#endif
+
+  // Images with restart markers, drawn from RAM on one core then on two
+  if (restarts) {
+    fs::File file = SPIFFS.open(path, "r");
+    uint32_t size = file.size();
+    uint8_t *data = (uint8_t *)malloc(size);
+    if (data && (file.read(data, size) == size)) {
+      for (uint8_t cores = 1; cores < 3; cores++) {
+        fex.setJpegParallel(cores == 2);
+        tft.fillScreen(TFT_BLACK);
+        fex.drawJpeg(data, size, 0, 0, nullptr, &stats);
+        Serial.print("  drawJpeg() RAM, "); Serial.print(cores); Serial.print(" core : ");
+        Serial.print(stats.totalTime); Serial.println(" us");
+      }
+      fex.setJpegParallel(false);
+    }
+    free(data);
+    file.close();
+  }
+
+#ifdef USE_JPEGDECODER
+  // JPEGDecoder library, decode only
+  uint32_t t = micros();
+  if (JpegDec.decodeFsFile(path)) {
+    while (JpegDec.read()) ;
+    t = micros() - t;
+    Serial.print("  JPEGDecoder   : "); Serial.print(t); Serial.println(" us");
+  }
+#endif
+}
+//====================================================================================
@@ -0,0 +1,143 @@
+/*====================================================================================
+
+     PC benchmark of the TFT_eFEX RGB888 to RGB565 colour conversion
+
+  ==================================================================================*/
+
+// Times each converter in TFT_eFEX_Color.h on a 320 x 240 gradient, with the same
+// code as the library: one pixel at a time, four pixels per 32 bit word step (SWAR,
+// used on the ESP8266 and ESP32), eight pixels per SSE2 step (used on a PC) and
+// ordered dithering (see setColorDither()). Pixels are converted both as the native
+// Jpeg decoder does (RGB to panel byte order) and as drawBmp() does (BGR to 565). The
+// fast converters are checked against the one pixel at a time result.
+//
+// Also prints the error of the 565 image seen through a 4x4 box blur (roughly what
+// the eye sees), which is what dithering improves. Build and run from this folder:
+//
+//   g++ -O2 -I../../.. convert_bench.cpp -o convert_bench
+//   ./convert_bench
+//
+// Add -fno-tree-vectorize to stop the compiler vectorising the one pixel at a time
+// loop itself, which gives a fairer idea of the gains on a microcontroller.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TFT_eFEX_Color.h"
+
+#define WIDTH   320
+#define HEIGHT  240
+#define REPEATS 200 // Conversions of the whole image, the average time is printed
+
+uint8_t  rgb[WIDTH * HEIGHT * 3];
+uint16_t pix[WIDTH * HEIGHT];
+
+double microsNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+enum { SCALAR, SWAR, SSE2, DITHER, CONVERTERS };
+const char *names[] = { "one at a time", "SWAR", "SSE2", "dithered" };
+
+// Convert the image a row at a time, as drawBmp() and the native decoder do
+void convert(uint8_t converter, bool bgr, bool swap)
+{
+  for (uint16_t y = 0; y < HEIGHT; y++) {
+    const uint8_t *src = rgb + y * WIDTH * 3;
+    uint16_t *dst = pix + y * WIDTH;
+    switch (converter) {
+      case SCALAR: rgb565Scalar(src, dst, WIDTH, bgr, swap); break;
+      case SWAR:   rgb565Swar(src, dst, WIDTH, bgr, swap); break;
+#if defined (__SSE2__)
+      case SSE2:   rgb565Sse2(src, dst, WIDTH, bgr, swap); break;
+#endif
+      case DITHER: rgb565DitherRow(src, dst, WIDTH, 0, y, bgr, swap); break;
+    }
+  }
+}
+
+uint32_t checksum(void)
+{
+  uint32_t sum = 2166136261;
+  for (uint32_t i = 0; i < WIDTH * HEIGHT; i++) sum = (sum ^ pix[i]) * 16777619;
+  return sum;
+}
+
+// Mean absolute difference, in 8 bit levels, between the 4x4 box averages of the
+// original and of the 565 image (not swapped) with its channels expanded to 8 bits
+double blurError(void)
+{
+  double total = 0;
+  uint32_t count = 0;
+  for (uint16_t y = 0; y + 4 <= HEIGHT; y += 4) {
+    for (uint16_t x = 0; x + 4 <= WIDTH; x += 4) {
+      int32_t a[3] = { 0 }, b[3] = { 0 };
+      for (uint8_t j = 0; j < 4; j++) {
+        for (uint8_t i = 0; i < 4; i++) {
+          uint32_t n = (y + j) * WIDTH + x + i;
+          uint16_t c = pix[n];
+          for (uint8_t k = 0; k < 3; k++) a[k] += rgb[3 * n + k];
+          b[0] += ((c >> 11) & 0x1F) * 255 / 31;
+          b[1] += ((c >> 5) & 0x3F) * 255 / 63;
+          b[2] += (c & 0x1F) * 255 / 31;
+        }
+      }
+      for (uint8_t k = 0; k < 3; k++) total += abs(a[k] - b[k]) / 16.0;
+      count += 3;
+    }
+  }
+  return total / count;
+}
+
+int main(void)
+{
+  // Slow diagonal gradients, the worst case for banding
+  for (uint16_t y = 0; y < HEIGHT; y++) {
+    for (uint16_t x = 0; x < WIDTH; x++) {
+      uint8_t *p = rgb + 3 * (y * WIDTH + x);
+      p[0] = x * 64 / WIDTH + 96;
+      p[1] = (x + y) * 48 / (WIDTH + HEIGHT) + 32;
+      p[2] = y * 40 / HEIGHT + 160;
+    }
+  }
+
+  printf("%d x %d pixels, %d repeats\n", WIDTH, HEIGHT, REPEATS);
+
+  bool ok = true;
+  for (uint8_t bmp = 0; bmp < 2; bmp++) {
+    printf(bmp ? "BGR to 565 (drawBmp)\n" : "RGB to panel order (native Jpeg decoder)\n");
+
+    convert(SCALAR, bmp, !bmp);
+    uint32_t expected = checksum();
+
+    for (uint8_t converter = 0; converter < CONVERTERS; converter++) {
+#if !defined (__SSE2__)
+      if (converter == SSE2) continue;
+#endif
+      convert(converter, bmp, !bmp); // Warm up
+      double t = microsNow();
+      for (uint16_t i = 0; i < REPEATS; i++) convert(converter, bmp, !bmp);
+      t = (microsNow() - t) / REPEATS;
+
+      printf("  %-13s : %8.1f us, %7.1f Mpixels/s", names[converter], t, WIDTH * HEIGHT / t);
+      if (converter != DITHER && checksum() != expected) {
+        printf(", WRONG PIXELS");
+        ok = false;
+      }
+      printf("\n");
+    }
+  }
+
+  // Image error after blurring, with and without dithering
+  for (uint8_t converter = SCALAR; converter <= DITHER; converter += DITHER) {
+    convert(converter, false, false);
+    printf("%-9s blurred error %.2f levels\n", converter == DITHER ? "Dithered" : "Truncated", blurError());
+  }
+
+  return ok ? 0 : 1;
+}
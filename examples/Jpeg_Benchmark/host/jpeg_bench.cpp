@@ -0,0 +1,140 @@
+/*====================================================================================
+
+     PC version of the Jpeg_Benchmark sketch for the bundled TFT_eFEX jpeg decoder
+
+  ==================================================================================*/
+
+// Decodes the images with the same decoder source code as the sketch and prints the
+// same pixel checksums, so the two can be compared. Build and run from this folder:
+//
+//   g++ -O2 -I../../.. jpeg_bench.cpp ../../../TFT_eFEX_Jpeg.cpp -o jpeg_bench -pthread
+//   ./jpeg_bench ../data/*.jpg
+//
+// Add -DUSE_LIBJPEG and -ljpeg to the g++ line to time libjpeg on the same images.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TFT_eFEX_Jpeg.h"
+
+#ifdef USE_LIBJPEG
+  #include <jpeglib.h>
+#endif
+
+#define REPEATS 100 // Decodes per image, the average time is printed
+
+// Image held in RAM
+typedef struct {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t index;
+} source_t;
+
+uint32_t checksum;
+
+//====================================================================================
+//                        Decoder input and output functions
+//====================================================================================
+uint32_t arrayInput(void *src, uint8_t *buf, uint32_t len)
+{
+  source_t *s = (source_t *)src;
+  if (len > s->size - s->index) len = s->size - s->index;
+  if (buf) memcpy(buf, s->data + s->index, len);
+  s->index += len;
+  return len;
+}
+
+bool checksumOutput(void *, int16_t, int16_t, uint16_t w, uint16_t h, uint16_t *pixels)
+{
+  for (uint16_t i = 0; i < w * h; i++) checksum = (checksum ^ pixels[i]) * 16777619;
+  return true;
+}
+
+double microsNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+//====================================================================================
+//                                     Main
+//====================================================================================
+int main(int argc, char **argv)
+{
+  TFT_eFEX_Jpeg *jpeg = (TFT_eFEX_Jpeg *)malloc(sizeof(TFT_eFEX_Jpeg));
+
+  for (int i = 1; i < argc; i++) {
+    FILE *fp = fopen(argv[i], "rb");
+    if (!fp) continue;
+    fseek(fp, 0, SEEK_END);
+    source_t src;
+    src.size = ftell(fp);
+    src.data = (uint8_t *)malloc(src.size);
+    fseek(fp, 0, SEEK_SET);
+    src.size = fread(src.data, 1, src.size, fp);
+    fclose(fp);
+
+    printf("%s\n", argv[i]);
+
+    for (uint8_t scale = 0; scale < 4; scale += 3) {
+      int result = 0;
+      double t = microsNow();
+      for (int n = 0; n < REPEATS; n++) {
+        src.index = 0;
+        checksum = 2166136261;
+        result = jpeg->prepare(arrayInput, &src);
+        if (result == FJPG_OK) result = jpeg->decode(checksumOutput, nullptr, scale);
+      }
+      t = (microsNow() - t) / REPEATS;
+      printf("  Bundled decode 1/%d : %.0f us, result %d, checksum %X\n", 1 << scale, t, result, checksum);
+    }
+
+    // Images with restart markers decoded in strips by two threads
+    if (jpeg->restartInterval) {
+      int result = 0;
+      double t = microsNow();
+      for (int n = 0; n < REPEATS; n++) {
+        src.index = 0;
+        checksum = 2166136261;
+        result = jpeg->prepare(arrayInput, &src);
+        if (result == FJPG_OK) result = jpeg->decodeParallel(src.data, src.size, checksumOutput, nullptr);
+      }
+      t = (microsNow() - t) / REPEATS;
+      printf("  Parallel decode    : %.0f us, result %d\n", t, result);
+    }
+
+#ifdef USE_LIBJPEG
+    // libjpeg with its fastest settings, output as 565 for a like for like comparison
+    double t = microsNow();
+    for (int n = 0; n < REPEATS; n++) {
+      jpeg_decompress_struct cinfo;
+      jpeg_error_mgr jerr;
+      cinfo.err = jpeg_std_error(&jerr);
+      jpeg_create_decompress(&cinfo);
+      jpeg_mem_src(&cinfo, src.data, src.size);
+      jpeg_read_header(&cinfo, TRUE);
+      cinfo.dct_method = JDCT_IFAST;
+      cinfo.do_fancy_upsampling = FALSE;
+#ifdef JCS_EXTENSIONS
+      cinfo.out_color_space = JCS_RGB565;
+#endif
+      jpeg_start_decompress(&cinfo);
+      JSAMPLE *line = (JSAMPLE *)malloc(cinfo.output_width * cinfo.output_components * 2);
+      while (cinfo.output_scanline < cinfo.output_height) jpeg_read_scanlines(&cinfo, &line, 1);
+      free(line);
+      jpeg_finish_decompress(&cinfo);
+      jpeg_destroy_decompress(&cinfo);
+    }
+    t = (microsNow() - t) / REPEATS;
+    printf("  libjpeg            : %.0f us\n", t);
+#endif
+
+    free(src.data);
+  }
+
+  free(jpeg);
+  return 0;
+}
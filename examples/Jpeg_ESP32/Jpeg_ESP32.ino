@@ -57,6 +57,28 @@ void setup()
 
   fex.listSPIFFS(); // Lists the files so you can see what is in the SPIFFS
 
+  // Compare file read times with and without the read-ahead buffer
+  readBufferTest("/Baboon.jpg");
+  readBufferTest("/Tiger.jpg");
+}
+
+//====================================================================================
+//                     Time drawJpgFile() for a few read buffer sizes
+//====================================================================================
+void readBufferTest(const char *path)
+{
+  uint32_t sizes[] = { 0, 4096, 16384 };
+  image_stats_t stats;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    fex.setJpgReadBuffer(sizes[i]);
+    fex.drawJpgFile(SPIFFS, path, 0, 0, 0, 0, 0, 0, JPEG_DIV_NONE, &stats);
+    Serial.print(path); Serial.print(" read buffer "); Serial.print(sizes[i]);
+    Serial.print(" : total "); Serial.print(stats.totalTime);
+    Serial.print(" us, read "); Serial.print(stats.readTime); Serial.println(" us");
+  }
+
+  fex.setJpgReadBuffer(JPG_READ_BUFFER); // Restore the default
 }
 
 //====================================================================================
@@ -1,12 +1,9 @@
 /*====================================================================================
 
-           Test jpeg rendering with ESP8266 and JPEGDecoder library
+         Test jpeg rendering with ESP8266 and the bundled TFT_eFEX jpeg decoder
 
   ==================================================================================*/
 
-// The Jpeg library required can be found here:
-// https://github.com/Bodmer/JPEGDecoder
-
 // The example images used to test this sketch can be found in the sketch
 // Data folder, press Ctrl+K to see this folder. Use the IDE "Tools" menu
 // "ESP8266 Sketch Data Upload" option to upload the images to SPIFFS.
@@ -0,0 +1,57 @@
+/*
+  Draws a test screen and then waits for a PC to capture it with screenServer().
+
+  Example for library:
+  https://github.com/Bodmer/TFT_eFEX
+
+  The PC client can be the Processing sketch supplied with TFT_eSPI (which uses
+  the original protocol, one request byte per NPIXELS pixels) or the program in
+  the "host" folder of this sketch, which uses protocol 2: whole lines are sent
+  as the client grants them, so the capture time is set by the serial link speed.
+  Lines are compressed (RLE or LZ, see SCREEN_COMPRESSION in TFT_eFEX.h) if the
+  client can decode them, a screen of flat colours and text sends 5 to 30 times
+  fewer bytes.
+
+  The TFT must have its MISO line connected, the pixels are read back from it.
+
+  Build and run the host program on a Linux PC with:
+    g++ -O2 screen_client.cpp -o screen_client
+    ./screen_client /dev/ttyUSB0 921600
+*/
+
+// https://github.com/Bodmer/TFT_eSPI
+#include <TFT_eSPI.h>              // Hardware-specific library
+TFT_eSPI tft = TFT_eSPI();         // Invoke custom library
+
+// https://github.com/Bodmer/TFT_eFEX
+#include <TFT_eFEX.h>              // Include the extension graphics functions library
+TFT_eFEX  fex = TFT_eFEX(&tft);    // Create TFT_eFX object "efx" with pointer to "tft" object
+
+// -------------------------------------------------------------------------
+// Setup
+// -------------------------------------------------------------------------
+void setup(void) {
+  Serial.begin(921600); // Must match the PC client, faster is better
+
+  tft.init();
+  tft.setRotation(1);
+
+  // Flat colours, text and a gradient
+  tft.fillScreen(TFT_NAVY);
+  tft.fillRoundRect(10, 10, tft.width() - 20, 40, 8, TFT_DARKGREY);
+  tft.setTextColor(TFT_WHITE);
+  tft.drawString("Screen server", 20, 22, 4);
+  for (int16_t x = 0; x < tft.width(); x++)
+  {
+    tft.drawFastVLine(x, tft.height() - 60, 50, fex.rainbowColor(x * 191 / tft.width()));
+  }
+}
+
+// -------------------------------------------------------------------------
+// Main loop
+// -------------------------------------------------------------------------
+void loop()
+{
+  // Wait up to START_TIMEOUT for a client, then capture the screen
+  fex.screenServer();
+}
@@ -0,0 +1,353 @@
+/*====================================================================================
+
+     Linux PC client for the TFT_eFEX screenServer() protocol 2
+
+  ==================================================================================*/
+
+// Captures the TFT screen over a serial port and saves it as a 24 bit bmp file.
+// Build and run from this folder:
+//
+//   g++ -O2 screen_client.cpp -o screen_client
+//   ./screen_client /dev/ttyUSB0 921600 [screen.bmp] [methods]
+//
+// The baud rate must match Serial.begin() in the sketch. The default file name is the
+// one sent by the device with ".bmp" added. methods is the compression methods to
+// offer: 0 = none, 2 = RLE, 4 = LZ, 6 = either (default).
+//
+// Protocol 2, the client:
+//   sends 'V' and a byte with bit 1 set if it can decode RLE lines, bit 2 for LZ
+//   reads the header: 'W' width (2 bytes MSB first), 'H' height (2 bytes), 'Y' bits
+//   per pixel (16 or 24), 'V' version, 'C' compression (0 none, 1 RLE, 2 LZ), '?' file
+//   name, '.', extension and type characters
+//   grants lines with 'G' n (n = 1-255), the device sends lines top to bottom as long
+//   as it has credit, 565 pixels MSB first or 24 bit pixels as R, G, B. Compressed
+//   lines start with their length (2 bytes, MSB first), see decodeLine()
+//   may send 'X' to abort
+// WINDOW lines are granted at the start and each line is granted again as it arrives,
+// so the device never waits for a grant.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+
+#define WINDOW     32   // Lines granted ahead
+#define TIMEOUT  2000   // ms to wait for data
+
+int port = -1;
+
+double millisNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+//====================================================================================
+//                                 Serial port
+//====================================================================================
+bool openPort(const char *path, long baud)
+{
+  static const struct { long baud; speed_t speed; } speeds[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 },
+    { 921600, B921600 }, { 1000000, B1000000 }, { 1500000, B1500000 }, { 2000000, B2000000 }
+  };
+  speed_t speed = 0;
+  for (uint8_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+    if (speeds[i].baud == baud) speed = speeds[i].speed;
+  }
+  if (!speed) {
+    fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+    return false;
+  }
+
+  port = open(path, O_RDWR | O_NOCTTY);
+  if (port < 0) {
+    perror(path);
+    return false;
+  }
+
+  struct termios tty;
+  if (tcgetattr(port, &tty) == 0) {
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    tcsetattr(port, TCSANOW, &tty);
+  }
+  tcflush(port, TCIOFLUSH);
+  return true;
+}
+
+// Read exactly len bytes, false on a time-out
+bool readBytes(uint8_t *buf, uint32_t len)
+{
+  while (len) {
+    struct pollfd p = { port, POLLIN, 0 };
+    if (poll(&p, 1, TIMEOUT) <= 0) return false;
+    ssize_t n = read(port, buf, len);
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool readByte(uint8_t *b)
+{
+  return readBytes(b, 1);
+}
+
+void sendBytes(const uint8_t *buf, uint32_t len)
+{
+  if (write(port, buf, len) != (ssize_t)len) perror("write");
+}
+
+void grant(uint8_t lines)
+{
+  uint8_t cmd[2] = { 'G', lines };
+  sendBytes(cmd, 2);
+}
+
+//====================================================================================
+//                                   Header
+//====================================================================================
+#define RAW 0
+#define RLE 1
+#define LZ  2
+
+typedef struct {
+  uint16_t width, height;
+  uint8_t  bits;
+  uint8_t  version;
+  uint8_t  compression;
+  char     name[256];
+} header_t;
+
+// Read a field delimiter and check it
+bool expect(char c)
+{
+  uint8_t b;
+  if (!readByte(&b)) return false;
+  if (b != c) fprintf(stderr, "Header: expected '%c', got 0x%02X\n", c, b);
+  return b == c;
+}
+
+bool readHeader(header_t *hd)
+{
+  uint8_t b[2];
+  if (!expect('W') || !readBytes(b, 2)) return false;
+  hd->width = (b[0] << 8) | b[1];
+  if (!expect('H') || !readBytes(b, 2)) return false;
+  hd->height = (b[0] << 8) | b[1];
+  if (!expect('Y') || !readByte(&hd->bits)) return false;
+  if (!expect('V') || !readByte(&hd->version)) return false;
+  if (!expect('C') || !readByte(&hd->compression)) return false;
+  if (!expect('?')) return false;
+
+  uint16_t n = 0;
+  while (readByte(b) && b[0] != '.') {
+    if (n < sizeof(hd->name) - 1) hd->name[n++] = b[0];
+  }
+  hd->name[n] = 0;
+  return readBytes(b, 2); // Extension and type characters, not used here
+}
+
+//====================================================================================
+//                               Line decompression
+//====================================================================================
+// Decode n bytes of a compressed line into win + w pixels, after the line above. Each
+// code starts with a byte c:
+//   c < 0x80         : c + 1 literal pixels follow
+// RLE
+//   c >= 0x80        : the next pixel repeated (c & 0x7F) + 1 times
+// LZ, over the line above (all zero for the first line) and this line
+//   0x80 <= c < 0xC0 : (c & 0x3F) + 1 pixels copied from the line above
+//   c >= 0xC0        : (c & 0x3F) + 1 pixels copied from a distance (2 bytes, MSB first)
+//                      back in pixels, the copy may overlap the pixels it makes
+// Returns false if the data is bad
+bool decodeLine(const uint8_t *in, uint32_t n, uint8_t *win, uint16_t w, uint8_t bytes, uint8_t method)
+{
+  const uint8_t *end = in + n;
+  uint8_t *line = win + w * bytes;
+  uint32_t x = 0;
+
+  while (x < w) {
+    if (in >= end) return false;
+    uint8_t  c = *in++;
+    uint32_t count;
+
+    if (c < 0x80) {
+      count = c + 1;
+      if (x + count > w || in + count * bytes > end) return false;
+      memcpy(line + x * bytes, in, count * bytes);
+      in += count * bytes;
+    }
+    else if (method == RLE) {
+      count = (c & 0x7F) + 1;
+      if (x + count > w || in + bytes > end) return false;
+      for (uint32_t i = 0; i < count; i++) memcpy(line + (x + i) * bytes, in, bytes);
+      in += bytes;
+    }
+    else if (c < 0xC0) {
+      count = (c & 0x3F) + 1;
+      if (x + count > w) return false;
+      memcpy(line + x * bytes, win + x * bytes, count * bytes);
+    }
+    else {
+      count = (c & 0x3F) + 1;
+      if (x + count > w || in + 2 > end) return false;
+      uint32_t d = (in[0] << 8) | in[1];
+      in += 2;
+      if (d == 0 || d > w + x) return false;
+      // Byte at a time so an overlapping copy repeats the pixels it has made
+      uint8_t *dst = line + x * bytes;
+      const uint8_t *src = dst - d * bytes;
+      for (uint32_t i = 0; i < count * bytes; i++) dst[i] = src[i];
+    }
+    x += count;
+  }
+
+  return in == end;
+}
+
+//====================================================================================
+//                                   Bmp file
+//====================================================================================
+void put16(FILE *f, uint16_t v) { fputc(v & 0xFF, f); fputc(v >> 8, f); }
+void put32(FILE *f, uint32_t v) { put16(f, v & 0xFFFF); put16(f, v >> 16); }
+
+// rgb holds width x height R, G, B pixels, top row first
+bool writeBmp(const char *path, const uint8_t *rgb, uint16_t w, uint16_t h)
+{
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint32_t row = (w * 3 + 3) & ~3;
+  fputc('B', f); fputc('M', f);
+  put32(f, 54 + row * h); put32(f, 0); put32(f, 54);
+  put32(f, 40); put32(f, w); put32(f, h); put16(f, 1); put16(f, 24);
+  put32(f, 0); put32(f, row * h); put32(f, 2835); put32(f, 2835); put32(f, 0); put32(f, 0);
+
+  for (int32_t y = h - 1; y >= 0; y--) {
+    const uint8_t *p = rgb + y * w * 3;
+    for (uint16_t x = 0; x < w; x++, p += 3) {
+      fputc(p[2], f); fputc(p[1], f); fputc(p[0], f);
+    }
+    for (uint32_t i = w * 3; i < row; i++) fputc(0, f);
+  }
+  fclose(f);
+  return true;
+}
+
+//====================================================================================
+//                                    Main
+//====================================================================================
+int main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s port [baud] [file.bmp]\n", argv[0]);
+    return 1;
+  }
+  if (!openPort(argv[1], argc > 2 ? atol(argv[2]) : 921600)) return 1;
+
+  // Start the server, it is polled for START_TIMEOUT after each screenServer() call
+  uint8_t start[2] = { 'V', (uint8_t)(argc > 4 ? atoi(argv[4]) : (1 << RLE) | (1 << LZ)) };
+  sendBytes(start, 2);
+  double startTime = millisNow();
+
+  header_t hd;
+  if (!readHeader(&hd)) {
+    fprintf(stderr, "No protocol 2 header, check the baud rate and that the library is up to date\n");
+    return 1;
+  }
+  const char *methods[] = { "none", "RLE", "LZ" };
+  printf("%u x %u, %u bits per pixel, protocol %u, compression %s, name \"%s\"\n", hd.width, hd.height, hd.bits,
+         hd.version, hd.compression <= LZ ? methods[hd.compression] : "unknown", hd.name);
+  if (hd.compression > LZ) return 1;
+
+  // Line above then this line, and the compressed line
+  uint8_t  bytes = hd.bits >= 24 ? 3 : 2;
+  uint32_t lineSize = hd.width * bytes;
+  uint8_t *win = (uint8_t *)calloc(2 * lineSize, 1);
+  uint8_t *line = win + lineSize;
+  uint8_t *in = (uint8_t *)malloc(65535);
+  uint8_t *rgb = (uint8_t *)malloc(hd.width * hd.height * 3);
+  if (!win || !in || !rgb) return 1;
+  uint32_t received = 0;
+
+  uint16_t granted = hd.height < WINDOW ? hd.height : WINDOW;
+  grant(granted);
+
+  for (uint16_t y = 0; y < hd.height; y++) {
+    bool ok;
+    if (hd.compression == RAW) {
+      ok = readBytes(line, lineSize);
+      received += lineSize;
+    }
+    else {
+      uint8_t len[2];
+      ok = readBytes(len, 2);
+      uint32_t n = (len[0] << 8) | len[1];
+      if (ok) ok = readBytes(in, n);
+      if (ok && !decodeLine(in, n, win, hd.width, bytes, hd.compression)) {
+        fprintf(stderr, "Bad data at line %u\n", y);
+        ok = false;
+      }
+      received += 2 + n;
+    }
+    if (!ok) {
+      fprintf(stderr, "Capture failed at line %u\n", y);
+      sendBytes((const uint8_t *)"X", 1);
+      return 1;
+    }
+    if (granted < hd.height) {
+      grant(1);
+      granted++;
+    }
+
+    uint8_t *p = rgb + y * hd.width * 3;
+    for (uint16_t x = 0; x < hd.width; x++, p += 3) {
+      if (bytes == 3) memcpy(p, line + 3 * x, 3);
+      else {
+        // 565 MSB first, expanded to 8 bits per channel
+        uint16_t c = (line[2 * x] << 8) | line[2 * x + 1];
+        p[0] = ((c >> 8) & 0xF8) | (c >> 13);
+        p[1] = ((c >> 3) & 0xFC) | ((c >> 9) & 0x03);
+        p[2] = ((c << 3) & 0xF8) | ((c >> 2) & 0x07);
+      }
+    }
+    memcpy(win, line, lineSize); // Becomes the line above
+  }
+
+  double t = millisNow() - startTime;
+  uint32_t total = hd.width * hd.height * bytes;
+  printf("%u bytes in %.0f ms, %.0f bytes/s, %u bytes received (%.1f : 1)\n", total, t, total * 1000.0 / t,
+         received, (double)total / received);
+
+  // Default name from the device, without any path
+  char path[300];
+  if (argc > 3) snprintf(path, sizeof(path), "%s", argv[3]);
+  else {
+    const char *base = strrchr(hd.name, '/');
+    snprintf(path, sizeof(path), "%s.bmp", base ? base + 1 : hd.name);
+  }
+  if (!writeBmp(path, rgb, hd.width, hd.height)) return 1;
+  printf("Saved %s\n", path);
+
+  free(win);
+  free(in);
+  free(rgb);
+  close(port);
+  return 0;
+}